@@ -30,12 +30,12 @@
 using namespace atque;
 namespace algo = boost::algorithm;
 
-void CLUTResource::Load(const std::vector<uint8>& data)
+void CLUTResource::Load(marathon::ByteView data)
 {
 	if (data.size() == 6 + 256 * 6)
 	{
 		// M2/Win95 'clut'
-		AIStreamBE stream(&data[0], data.size());
+		AIStreamBE stream(data.data(), data.size());
 		int16 count;
 		stream >> count;
 		stream.ignore(4); // unknown, id
@@ -50,7 +50,7 @@ void CLUTResource::Load(const std::vector<uint8>& data)
 	}
 	else
 	{
-		AIStreamBE stream(&data[0], data.size());
+		AIStreamBE stream(data.data(), data.size());
 		stream.ignore(4); // seed
 		int16 flags;
 		stream >> flags;
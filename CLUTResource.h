@@ -21,6 +21,7 @@
 #ifndef CLUT_RESOURCE_H
 #define CLUT_RESOURCE_H
 
+#include "ferro/ChunkData.h"
 #include "ferro/cstypes.h"
 
 #include <string>
@@ -32,8 +33,8 @@ namespace atque
 	{
 	public:
 		CLUTResource() { }
-		CLUTResource(const std::vector<uint8>& data) { Load(data); }
-		void Load(const std::vector<uint8>&);
+		CLUTResource(marathon::ByteView data) { Load(data); }
+		void Load(marathon::ByteView);
 		std::vector<uint8> Save() const;
 
 		bool Import(const std::string& path);
@@ -21,14 +21,10 @@
 #include "ferro/AStream.h"
 #include "PICTResource.h"
 
-#include <bitset>
+#include <algorithm>
 #include <fstream>
+#include <limits>
 #include <sstream>
-#include <wx/mstream.h>
-#include <wx/stream.h>
-#include <wx/image.h>
-#include <wx/bitmap.h>
-#include <wx/dcmemory.h>
 #include <boost/algorithm/string/predicate.hpp>
 
 #include <string.h>
@@ -36,9 +32,17 @@
 using namespace atque;
 namespace algo = boost::algorithm;
 
-void PICTResource::Load(const std::vector<uint8>& data)
+void PICTResource::Load(marathon::ByteView data)
 {
-	AIStreamBE stream(&data[0], data.size());
+	is_cinemascope = false;
+	if (data.size() < 10)
+	{
+		Clear();
+		why_unparsed_ = "PICT is too short";
+		return;
+	}
+
+	AIStreamBE stream(data.data(), data.size());
 
 	int16 size;
 	stream >> size;
@@ -54,9 +58,11 @@ void PICTResource::Load(const std::vector<uint8>& data)
 	// just in case cinemascope
 	real_width = rect.right - rect.left;
 	real_height = rect.bottom - rect.top;
-	image = std::make_unique<wxBitmap>( std::max(640, real_width),
-										std::max(480, real_height));
-	wxMemoryDC dc( *image );
+	width_ = std::max(640, real_width);
+	height_ = std::max(480, real_height);
+	pixels_.assign(width_ * height_ * 3, 0);
+	jpeg_.clear();
+	why_unparsed_.clear();
 	try 
 	{
 		bool done = false;
@@ -166,7 +172,7 @@ void PICTResource::Load(const std::vector<uint8>& data)
 			case 0x009b: {	// Direct CopyBits with clipping region
 				bool packed = (opcode == 0x0098 || opcode == 0x0099);
 				bool clipped = (opcode == 0x0099 || opcode == 0x009b);
-				LoadCopyBits(stream, packed, clipped, dc);
+				LoadCopyBits(stream, packed, clipped);
 				break;
 			}
 
@@ -189,10 +195,25 @@ void PICTResource::Load(const std::vector<uint8>& data)
 				break;
 			}
 		}
-		auto tmp = std::make_unique<wxBitmap>( image->GetSubBitmap( wxRect(0, 0,
-																		   std::min(real_width, image->GetWidth()),
-																		   std::min(real_height, image->GetHeight())) ));
-		image = std::move(tmp);
+		// keep only the part of the canvas in use
+		int width = std::min(real_width, width_);
+		int height = std::min(real_height, height_);
+		if (width < width_)
+		{
+			for (int y = 1; y < height; ++y)
+			{
+				memmove(&pixels_[y * width * 3], &pixels_[y * width_ * 3], width * 3);
+			}
+		}
+		width_ = width;
+		height_ = height;
+		pixels_.resize(width_ * height_ * 3);
+		pixels_.shrink_to_fit();
+		if (!jpeg_.empty())
+		{
+			std::vector<uint8>().swap(pixels_);
+		}
+
 		if( real_width != rect.right - rect.left ) {
 			is_cinemascope = true;
 		}
@@ -200,20 +221,46 @@ void PICTResource::Load(const std::vector<uint8>& data)
 	}
 	catch (const ParseError& e)
 	{
-		image.reset();
+		Clear();
 		why_unparsed_ = e.what();
 	}
 	catch (const AStream::failure& e)
 	{
-		image.reset();
+		Clear();
 		why_unparsed_ = "Error parsing PICT";
 	}
 }
 
-template <class T>
-static std::vector<T> UnpackRow(AIStreamBE& stream, int row_bytes)
+void PICTResource::Clear()
+{
+	width_ = height_ = 0;
+	std::vector<uint8>().swap(pixels_);
+	std::vector<uint8>().swap(jpeg_);
+	why_unparsed_.clear();
+}
+
+void PICTResource::DrawRow(int x, int y, const uint8* rgb, int count)
+{
+	if (y < 0 || y >= height_)
+		return;
+
+	if (x < 0)
+	{
+		rgb += -x * 3;
+		count += x;
+		x = 0;
+	}
+	count = std::min(count, width_ - x);
+
+	if (count > 0)
+		memcpy(&pixels_[(y * width_ + x) * 3], rgb, count * 3);
+}
+
+// unpacks a PackBits row of unit-byte pixels into dest, using packed to
+// hold the compressed bytes; short rows are padded with zeros, and long
+// ones are cut off at dest_size
+static void UnpackRow(AIStreamBE& stream, int row_bytes, int unit, std::vector<uint8>& packed, uint8* dest, int dest_size)
 {
-	std::vector<T> result;
 	int row_length;
 	if (row_bytes > 250)
 	{
@@ -228,68 +275,96 @@ static std::vector<T> UnpackRow(AIStreamBE& stream, int row_bytes)
 		row_length = length;
 	}
 
-	uint32 end = stream.tellg() + row_length;
-	while (stream.tellg() < end)
+	packed.resize(row_length);
+	stream.read(packed.data(), row_length);
+
+	const uint8* p = packed.data();
+	const uint8* end = p + row_length;
+	uint8* out = dest;
+	uint8* out_end = dest + dest_size;
+	while (p < end)
 	{
-		int8 c;
-		stream >> c;
+		int8 c = *p++;
+		if (c == -128)
+			continue;
 
 		if (c < 0)
 		{
-			int size = -c + 1;
-			T data;
-			stream >> data;
-			for (int i = 0; i < size; ++i)
+			if (end - p < unit)
+				break;
+
+			int size = std::min<int>((-c + 1) * unit, out_end - out);
+			if (unit == 1)
 			{
-				result.push_back(data);
+				memset(out, *p, size);
 			}
-		}
-		else if (c != -128)
-		{
-			int size = c + 1;
-			T data;
-			for (int i = 0; i < size; ++i)
+			else if (size > 0)
 			{
-				stream >> data;
-				result.push_back(data);
+				// copy one pixel, then keep doubling what's been copied
+				int done = std::min(unit, size);
+				memcpy(out, p, done);
+				while (done < size)
+				{
+					int n = std::min(done, size - done);
+					memcpy(out + done, out, n);
+					done += n;
+				}
 			}
+			p += unit;
+			out += size;
+		}
+		else
+		{
+			int size = std::min<int>((c + 1) * unit, end - p);
+			int copied = std::min<int>(size, out_end - out);
+			memcpy(out, p, copied);
+			p += size;
+			out += copied;
 		}
 	}
-	
-	return result;
+
+	memset(out, 0, out_end - out);
 }
 
-static std::vector<uint8> ExpandPixels(const std::vector<uint8>& scan_line, int depth)
+// expand[b] holds the pixels of byte b at depth 1, 2 or 4, leftmost
+// (high bits) first
+static void BuildExpandTable(int depth, uint8 expand[256][8])
 {
-	std::vector<uint8> result;
-	for (std::vector<uint8>::const_iterator it = scan_line.begin(); it != scan_line.end(); ++it)
+	int mask = (1 << depth) - 1;
+	for (int b = 0; b < 256; ++b)
 	{
-		if (depth == 4)
+		for (int i = 0; i < 8 / depth; ++i)
 		{
-			result.push_back((*it) >> 4);
-			result.push_back((*it) & 0xf);
-		}
-		else if (depth == 2)
-		{
-			result.push_back((*it) >> 6);
-			result.push_back(((*it) >> 4) & 0x3);
-			result.push_back(((*it) >> 2) & 0x3);
-			result.push_back((*it) & 0x3);
-		}
-		else if (depth == 1)
-		{
-			std::bitset<8> bits(*it);
-			for (int i = 0; i < 8; ++i)
-			{
-				result.push_back(bits[i] ? 1 : 0);
-			}
+			expand[b][i] = (b >> (8 - depth * (i + 1))) & mask;
 		}
 	}
+}
 
-	return result;
+// 5-bit color components scaled to 8 bits
+static const struct RGB555Table
+{
+	uint8 component[32];
+
+	RGB555Table()
+	{
+		for (int i = 0; i < 32; ++i)
+			component[i] = (i * 255 + 16) / 31;
+	}
+} rgb555;
+
+// converts count big-endian xRGB1555 pixels to RGB triples
+static void ConvertRGB555(const uint8* src, uint8* rgb, std::size_t count)
+{
+	for (std::size_t x = 0; x < count; ++x)
+	{
+		uint16 pixel = (src[x * 2] << 8) | src[x * 2 + 1];
+		rgb[x * 3] = rgb555.component[(pixel >> 10) & 0x1f];
+		rgb[x * 3 + 1] = rgb555.component[(pixel >> 5) & 0x1f];
+		rgb[x * 3 + 2] = rgb555.component[pixel & 0x1f];
+	}
 }
 
-void PICTResource::LoadCopyBits(AIStreamBE& stream, bool packed, bool clipped, wxDC& dc)
+void PICTResource::LoadCopyBits(AIStreamBE& stream, bool packed, bool clipped)
 {
 	if (!packed)
 		stream.ignore(4); // pmBaseAddr
@@ -303,23 +378,25 @@ void PICTResource::LoadCopyBits(AIStreamBE& stream, bool packed, bool clipped, w
 
 	uint16 width = rect.width();
 	uint16 height = rect.height();
-	uint16 pack_type, pixel_size;
+	uint16 pack_type, pixel_size, cmp_count;
 	if (is_pixmap)
 	{
 		stream.ignore(2); // pmVersion
 		stream >> pack_type;
 		stream.ignore(14); // packSize/hRes/vRes/pixelType
 		stream >> pixel_size;
-		stream.ignore(16); // cmpCount/cmpSize/planeBytes/pmTable/pmReserved
+		stream >> cmp_count;
+		stream.ignore(14); // cmpSize/planeBytes/pmTable/pmReserved
 	} 
 	else
 	{
 		pack_type = 0;
 		pixel_size = 1;
+		cmp_count = 1;
 	}
 
-	// read the color table
-	std::vector<wxColour> colorMap;
+	// the color table, as RGB triples; plain bitmaps are black on white
+	std::vector<uint8> colorMap(256 * 3);
 
 	if (is_pixmap && packed)
 	{
@@ -328,7 +405,6 @@ void PICTResource::LoadCopyBits(AIStreamBE& stream, bool packed, bool clipped, w
 		stream >> flags
 		       >> num_colors;
 		num_colors++;
-		colorMap.resize( num_colors );
 		for (int i = 0; i < num_colors; ++i)
 		{
 			uint16 index, red, green, blue;
@@ -341,9 +417,18 @@ void PICTResource::LoadCopyBits(AIStreamBE& stream, bool packed, bool clipped, w
 				index = i;
 			else
 				index &= 0xff;
-			colorMap[i] = wxColour(red>>8, green>>8, blue>>8) ;
+			// pixels are at most 8 bits, so later entries are unused
+			if (index > 255)
+				continue;
+			colorMap[index * 3] = red >> 8;
+			colorMap[index * 3 + 1] = green >> 8;
+			colorMap[index * 3 + 2] = blue >> 8;
 		}
 	}
+	else if (!is_pixmap)
+	{
+		std::fill_n(colorMap.begin(), 3, 0xff);
+	}
 
 	// src/dst/transfer mode
 	Rect src_rect, dst_rect;
@@ -365,118 +450,94 @@ void PICTResource::LoadCopyBits(AIStreamBE& stream, bool packed, bool clipped, w
 		stream.ignore(size - 2);
 	}
 
-	// the picture itself
-	if (pixel_size <= 8)
+	if (pixel_size != 1 && pixel_size != 2 && pixel_size != 4 && pixel_size != 8 && pixel_size != 16 && pixel_size != 32)
 	{
-		for (int y = 0; y < src_rect.bottom - src_rect.top; ++y)
-		{
-			std::vector<uint8> scan_line;
-			if (row_bytes < 8)
-			{
-				scan_line.resize(row_bytes);
-				stream.read(&scan_line[0], scan_line.size());
-			}
-			else
-			{
-				scan_line = UnpackRow<uint8>(stream, row_bytes);
-			}
-			if( pixel_size == 1) {
-				for (int x = 0; x < src_rect.right - src_rect.left; ++x)
-				{
-					if( scan_line[x] ) {
-						dc.SetPen( wxColor(255,255,255,255) );
-					} else {
-						dc.SetPen( wxColor(0,0,0,0) );
-					}
-					dc.DrawPoint(dst_rect.left + x, dst_rect.top + y);
-				}
-			} 
-			else if (pixel_size == 8)
-			{
-				for (int x = 0; x < src_rect.right - src_rect.left; ++x)
-				{
-					dc.SetPen( wxPen( colorMap[ scan_line[x] ] ) );
-					dc.DrawPoint(dst_rect.left + x, dst_rect.top + y);
-				}
-			}
-			else
-			{
-				std::vector<uint8> pixels = ExpandPixels(scan_line, pixel_size);
-				
-				for (int x = src_rect.left; x < src_rect.right; ++x)
-				{
-					dc.SetPen( wxPen( colorMap[ scan_line[x] ] ) );
-					dc.DrawPoint(dst_rect.left + x, dst_rect.top + y);
-				}
-			}
-		}		
+		std::ostringstream s;
+		s << "Unsupported pixel size " << pixel_size;
+		throw ParseError(s.str());
+	}
+
+	bool unpacked = (row_bytes < 8 || pack_type == 1);
+	if (!unpacked && !(pixel_size <= 8 || (pixel_size == 16 && (pack_type == 0 || pack_type == 3)) || (pixel_size == 32 && (pack_type == 0 || pack_type == 4))))
+	{
+		std::ostringstream s;
+		s << "Unsupported pack type " << pack_type;
+		throw ParseError(s.str());
 	}
-	else if (pixel_size == 16)
+
+	// rows are decoded into the same buffers every time
+	int bytes_per_pixel = (pixel_size + 7) / 8;
+	std::vector<uint8> row(std::max<int>(row_bytes, (width * pixel_size + 7) / 8));
+	std::vector<uint8> packed_row;
+	std::vector<uint8> indexes(width + 8);
+	uint8 expand[256][8];
+	if (pixel_size < 8)
+		BuildExpandTable(pixel_size, expand);
+
+	// the picture itself; every row of the pixmap is read, and the
+	// part inside src_rect is converted to RGB and copied to the canvas
+	std::vector<uint8> rgb(width * 3);
+	for (int y = 0; y < height; ++y)
 	{
-		for (int y = 0; y < src_rect.bottom - src_rect.top; ++y)
+		if (unpacked)
+		{
+			stream.read(row.data(), row_bytes);
+		}
+		else
 		{
-			std::vector<uint16> scan_line;
-			if (row_bytes < 8 || pack_type == 1)
+			UnpackRow(stream, row_bytes, (pixel_size == 16) ? 2 : 1, packed_row, row.data(), row.size());
+		}
+
+		if (pixel_size <= 8)
+		{
+			const uint8* index = row.data();
+			if (pixel_size < 8)
 			{
-				for (int x = 0; x < src_rect.right - src_rect.left; ++x)
+				int pixels_per_byte = 8 / pixel_size;
+				for (int i = 0; i * pixels_per_byte < width; ++i)
 				{
-					uint16 pixel;
-					stream >> pixel;
-					scan_line.push_back(pixel);
+					memcpy(&indexes[i * pixels_per_byte], expand[row[i]], pixels_per_byte);
 				}
-			}
-			else if (pack_type == 0 || pack_type == 3)
-			{
-				scan_line = UnpackRow<uint16>(stream, row_bytes);
+				index = indexes.data();
 			}
 
-			for (int x = src_rect.left; x < src_rect.right; ++x)
+			for (int x = 0; x < width; ++x)
 			{
-				int r = (scan_line[x] >> 10) & 0x1f;
-				int g = (scan_line[x] >> 5) & 0x1f;
-				int b = scan_line[x] & 0x1f;
-				wxColour c(
-					(r * 255 + 16) / 31,
-					(g * 255 + 16) / 31,
-					(b * 255 + 16) / 31,
-					0xff );
-				dc.SetPen( c );
-				dc.DrawPoint(dst_rect.left + x, dst_rect.top + y);				
+				memcpy(&rgb[x * 3], &colorMap[index[x] * 3], 3);
 			}
 		}
-	}
-	else if (pixel_size == 32)
-	{
-		for (int y = 0; y < src_rect.bottom - src_rect.top; ++y)
+		else if (pixel_size == 16)
+		{
+			ConvertRGB555(row.data(), rgb.data(), width);
+		}
+		else if (unpacked)
 		{
-			std::vector<uint8> scan_line;
-			if (row_bytes < 8 || pack_type == 1)
+			for (int x = 0; x < width; ++x)
 			{
-				scan_line.resize(width * 3);
-				for (int x = 0; x < src_rect.right - src_rect.left; ++x)
-				{
-					uint32 pixel;
-					stream >> pixel;
-					scan_line[x] = pixel >> 16;
-					scan_line[x + width] = pixel >> 8;
-					scan_line[x + width * 2] = pixel;
-				}
+				memcpy(&rgb[x * 3], &row[x * bytes_per_pixel + 1], 3);
 			}
-			else if (pack_type == 0 || pack_type == 4)
+		}
+		else
+		{
+			// packed rows hold each component for the whole row in
+			// turn, with alpha first if there are four
+			int planes = (cmp_count == 4) ? 4 : 3;
+			const uint8* red = &row[(planes - 3) * width];
+			for (int x = 0; x < width; ++x)
 			{
-				scan_line = UnpackRow<uint8>(stream, row_bytes);
+				rgb[x * 3] = red[x];
+				rgb[x * 3 + 1] = red[x + width];
+				rgb[x * 3 + 2] = red[x + width * 2];
 			}
+		}
 
-			for (int x = 0; x < src_rect.right - src_rect.left; ++x)
-			{
-				wxColour c(
-					scan_line[x],
-					scan_line[x + width],
-					scan_line[x + width * 2],
-					0xff );
-				dc.SetPen( c );
-				dc.DrawPoint(dst_rect.left + x, dst_rect.top + y);				
-			}
+		int source_y = rect.top + y;
+		if (source_y >= src_rect.top && source_y < src_rect.bottom)
+		{
+			int left = std::max(src_rect.left, rect.left);
+			int right = std::min(src_rect.right, rect.right);
+			if (right > left)
+				DrawRow(dst_rect.left + left - src_rect.left, dst_rect.top + source_y - src_rect.top, &rgb[(left - rect.left) * 3], right - left);
 		}
 	}
 					
@@ -537,17 +598,34 @@ void PICTResource::LoadJPEG(AIStreamBE& stream)
 	stream >> data_size;
 	stream.ignore(38); // frameCount/name/depth/clutID
 
-	std::vector<char> buf(data_size);
-	stream.read(buf.data(), buf.size());
+	// decoding is left to whoever displays or exports the picture
+	jpeg_.resize(data_size);
+	stream.read(jpeg_.data(), jpeg_.size());
 	stream.ignore(opcode_start + opcode_size - stream.tellg());
+}
 
-	wxMemoryInputStream mis(buf.data(), buf.size());
-	wxImage theBitmap;
-	if (!theBitmap.LoadFile(mis, wxBITMAP_TYPE_JPEG))
-		return;
+bool PICTResource::ExportBMP(const std::string& path) const
+{
+	if (pixels_.empty())
+		return false;
 
-	image = std::make_unique<wxBitmap>(theBitmap);
-	
+	BMP bitmap;
+	bitmap.SetBitDepth(24);
+	bitmap.SetSize(width_, height_);
+	for (int y = 0; y < height_; ++y)
+	{
+		const uint8* rgb = &pixels_[y * width_ * 3];
+		for (int x = 0; x < width_; ++x)
+		{
+			RGBApixel* pixel = bitmap(x, y);
+			pixel->Red = rgb[x * 3];
+			pixel->Green = rgb[x * 3 + 1];
+			pixel->Blue = rgb[x * 3 + 2];
+			pixel->Alpha = 0xff;
+		}
+	}
+
+	return bitmap.WriteToFile(path.c_str());
 }
 
 template <class T>
@@ -614,72 +692,74 @@ static std::vector<uint8> PackRow(const std::vector<T>& scan_line)
 	return result;
 }
 
-bool PICTResource::LoadRaw(const std::vector<uint8>& data, const std::vector<uint8>& clut)
+bool PICTResource::LoadRaw(marathon::ByteView data, marathon::ByteView clut)
 {
-	AIStreamBE stream(&data[0], data.size());
-	Rect rect;
-	rect.Load(stream);
-
-	int height = rect.height();
-	int width = rect.width();
-	
-	int16 depth;
-	stream >> depth;
-	
+	Clear();
+	is_cinemascope = false;
 
-	if (depth != 8 && depth != 16)
-		return false;
-
-//	bitmap_.SetBitDepth(depth);	
-//	bitmap_.SetSize(width, height);
-
-	if (depth == 8)
+	try
 	{
-		if (clut.size() != 6 + 256 * 6)
-			return false;
-
-		AIStreamBE clut_stream(&clut[0], clut.size());
-		clut_stream.ignore(6);
-		for (int i = 0; i < 256; ++i)
+		AIStreamBE stream(data.data(), data.size());
+		Rect rect;
+		rect.Load(stream);
+
+		int height = rect.height();
+		int width = rect.width();
+
+		int16 depth;
+		stream >> depth;
+
+		if (depth != 8 && depth != 16)
+			throw ParseError("Unsupported raw pict depth");
+
+		if (width <= 0 || height <= 0)
+			throw ParseError("Raw pict is truncated");
+
+		// both dimensions fit in 16 bits, so their product fits in 64;
+		// dividing the remaining bytes avoids overflowing the check
+		std::uint64_t count = static_cast<std::uint64_t>(width) * height;
+		if (count > (stream.maxg() - stream.tellg()) / (depth / 8))
+			throw ParseError("Raw pict is truncated");
+		if (count > std::numeric_limits<std::size_t>::max() / 3)
+			throw ParseError("Raw pict is too large");
+
+		// rows are converted straight from the resource data
+		const uint8* src = data.data() + stream.tellg();
+		std::vector<uint8> pixels(static_cast<std::size_t>(count) * 3);
+		if (depth == 8)
 		{
-			uint16 red, green, blue;
-			clut_stream >> red 
-				    >> green
-				    >> blue;
+			if (clut.size() != 6 + 256 * 6)
+				throw ParseError("Raw pict has no color table");
 
-			RGBApixel color = { static_cast<ebmpBYTE>(blue >> 8), static_cast<ebmpBYTE>(green >> 8), static_cast<ebmpBYTE>(red >> 8), 0xff };
-//			bitmap_.SetColor(i, color);
-		}
-		for (int y = 0; y < height; ++y)
-		{
-			for (int x = 0; x < width; ++x)
+			uint8 colorMap[256 * 3];
+			for (int i = 0; i < 256 * 3; ++i)
 			{
-				uint8 pixel;
-				stream >> pixel;
-//				bitmap_.SetPixel(x, y, bitmap_.GetColor(pixel));
+				colorMap[i] = clut[6 + i * 2];
 			}
-		}
-	}
-	else
-	{
-		for (int y = 0; y < height; ++y)
-		{
-			for (int x = 0; x < width; ++x)
+
+			for (std::size_t i = 0; i < count; ++i)
 			{
-				uint16 color;
-				stream >> color;
-				RGBApixel pixel;
-				pixel.Red = (color >> 10) & 0x1f;
-				pixel.Green = (color >> 5) & 0x1f;
-				pixel.Blue = color & 0x1f;
-				pixel.Red = (pixel.Red * 255 + 16) / 31;
-				pixel.Green = (pixel.Green * 255 + 16) / 31;
-				pixel.Blue = (pixel.Blue * 255 + 16) / 31;
-				pixel.Alpha = 0xff;
-				
-//				bitmap_.SetPixel(x, y, pixel);
+				memcpy(&pixels[i * 3], &colorMap[src[i] * 3], 3);
 			}
 		}
+		else
+		{
+			ConvertRGB555(src, pixels.data(), count);
+		}
+
+		width_ = real_width = width;
+		height_ = real_height = height;
+		pixels_.swap(pixels);
+	}
+	catch (const ParseError& e)
+	{
+		why_unparsed_ = e.what();
+		return false;
+	}
+	catch (const AStream::failure& e)
+	{
+		why_unparsed_ = "Error parsing raw pict";
+		return false;
 	}
 
 	return true;
@@ -897,3 +977,144 @@ void PICTResource::PixMap::Load(AIStreamBE& stream)
 	       >> pmTable
 	       >> pmReserved;
 }
+
+PICTCache& PICTCache::Shared()
+{
+	static PICTCache cache;
+	return cache;
+}
+
+// FNV-1a, over the picture and its color table
+static std::uint64_t HashResource(marathon::ByteView data, marathon::ByteView clut)
+{
+	std::uint64_t hash = 0xcbf29ce484222325ULL;
+	for (const uint8* p = data.begin(); p != data.end(); ++p)
+		hash = (hash ^ *p) * 0x100000001b3ULL;
+	for (const uint8* p = clut.begin(); p != clut.end(); ++p)
+		hash = (hash ^ *p) * 0x100000001b3ULL;
+
+	return hash;
+}
+
+// the same resource, looked at again, is the same bytes in memory
+static bool SameBytes(marathon::ByteView a, marathon::ByteView b)
+{
+	return a.size() == b.size() && (a.data() == b.data() || std::equal(a.begin(), a.end(), b.begin()));
+}
+
+bool PICTCache::Entry::Matches(marathon::ByteView data, marathon::ByteView clut) const
+{
+	return SameBytes(data, this->data.view()) && SameBytes(clut, this->clut.view());
+}
+
+std::shared_ptr<PICTResource> PICTCache::Load(bool raw, const marathon::ChunkData& data_handle, const marathon::ChunkData& clut_handle)
+{
+	marathon::ByteView data = data_handle.view();
+	marathon::ByteView clut = clut_handle.view();
+	Key key(raw, HashResource(data, clut), data.size());
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::map<Key, Entry>::iterator it = pictures_.find(key);
+		if (it != pictures_.end() && it->second.Matches(data, clut))
+		{
+			if (it->second.failed)
+				return std::shared_ptr<PICTResource>();
+
+			std::shared_ptr<PICTResource> pict = it->second.pict.lock();
+			if (pict)
+			{
+				Touch(pict);
+				return pict;
+			}
+		}
+	}
+
+	// decode without holding the lock; if two threads race on the same
+	// picture, both decode and the last one in wins
+	auto pict = std::make_shared<PICTResource>();
+	if (raw)
+		pict->LoadRaw(data, clut);
+	else
+		pict->Load(data);
+
+	bool failed = pict->IsUnparsed();
+	if (failed)
+		pict.reset();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::map<Key, Entry>::iterator it = pictures_.find(key);
+	if (it == pictures_.end())
+	{
+		it = pictures_.insert(std::make_pair(key, Entry())).first;
+		it->second.data = data_handle;
+		it->second.clut = clut_handle;
+	}
+	else if (!it->second.Matches(data, clut))
+	{
+		// a collision keeps whichever picture got there first
+		return pict;
+	}
+
+	it->second.pict = pict;
+	it->second.failed = failed;
+	if (pict)
+		Touch(pict);
+	else
+		Fail(key);
+	return pict;
+}
+
+void PICTCache::SetCapacity(std::size_t capacity)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	capacity_ = capacity;
+	if (recent_.size() > capacity_)
+		recent_.resize(capacity_);
+	while (failed_.size() > capacity_)
+	{
+		pictures_.erase(failed_.back());
+		failed_.pop_back();
+	}
+}
+
+// moves pict to the front of the recently used list, dropping the
+// oldest past capacity; the caller holds mutex_
+void PICTCache::Touch(const std::shared_ptr<PICTResource>& pict)
+{
+	std::list<std::shared_ptr<PICTResource>>::iterator it = std::find(recent_.begin(), recent_.end(), pict);
+	if (it != recent_.end())
+		recent_.splice(recent_.begin(), recent_, it);
+	else
+		recent_.push_front(pict);
+
+	if (recent_.size() > capacity_)
+	{
+		recent_.pop_back();
+
+		// forget pictures nothing holds any more
+		for (std::map<Key, Entry>::iterator it = pictures_.begin(); it != pictures_.end(); )
+		{
+			if (!it->second.failed && it->second.pict.expired())
+				it = pictures_.erase(it);
+			else
+				++it;
+		}
+	}
+}
+
+// remembers that key failed to decode, forgetting the oldest failure
+// past capacity; the caller holds mutex_
+void PICTCache::Fail(const Key& key)
+{
+	std::list<Key>::iterator it = std::find(failed_.begin(), failed_.end(), key);
+	if (it != failed_.end())
+		failed_.splice(failed_.begin(), failed_, it);
+	else
+		failed_.push_front(key);
+
+	if (failed_.size() > capacity_)
+	{
+		pictures_.erase(failed_.back());
+		failed_.pop_back();
+	}
+}
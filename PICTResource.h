@@ -21,15 +21,20 @@
 #ifndef PICT_RESOURCE_H
 #define PICT_RESOURCE_H
 
+#include "ferro/ChunkData.h"
 #include "ferro/cstypes.h"
 #include "EasyBMP.h"
 
 #include <stdexcept>
 #include <vector>
+#include <cstdint>
+#include <list>
+#include <map>
 #include <memory>
-#include <wx/bitmap.h>
+#include <mutex>
+#include <string>
+#include <tuple>
 
-class wxDC;
 class AIStreamBE;
 class AOStreamBE;
 class AOStreamLE;
@@ -40,18 +45,28 @@ namespace atque
 	class PICTResource
 	{
 	public:
-		PICTResource() { }
-		PICTResource(const std::vector<uint8>& data) { Load(data); }
-		void Load(const std::vector<uint8>&);
-		bool LoadRaw(const std::vector<uint8>& raw_data, const std::vector<uint8>& clut);
-		std::unique_ptr<wxBitmap> image;
+		PICTResource() : width_(0), height_(0) { }
+		PICTResource(marathon::ByteView data) { Load(data); }
+		void Load(marathon::ByteView);
+		bool LoadRaw(marathon::ByteView raw_data, marathon::ByteView clut);
 		bool is_cinemascope;
 		int real_width;
 		int real_height;
 
-		bool IsUnparsed() { return ! image; }
+		bool IsUnparsed() const { return pixels_.empty() && jpeg_.empty(); }
 		std::string WhyUnparsed() { return why_unparsed_; }
 
+		// the decoded picture, as rows of RGB triples top to bottom
+		int Width() const { return width_; }
+		int Height() const { return height_; }
+		const std::vector<uint8>& Pixels() const { return pixels_; }
+
+		// QuickTime JPEG pictures are kept compressed, with no pixels
+		bool IsJPEG() const { return !jpeg_.empty(); }
+		const std::vector<uint8>& JPEGData() const { return jpeg_; }
+
+		bool ExportBMP(const std::string& path) const;
+
 		struct Rect
 		{
 			int16 top;
@@ -71,9 +86,21 @@ namespace atque
 		};
 
 	private:
-		void LoadCopyBits(AIStreamBE& stream, bool packed, bool clipped, wxDC& dc);
+		void LoadCopyBits(AIStreamBE& stream, bool packed, bool clipped);
 		void LoadJPEG(AIStreamBE& stream);
 
+		void Clear();
+
+		// Load draws into a canvas at least 640x480, then crops it to
+		// the picture
+		int width_;
+		int height_;
+		std::vector<uint8> pixels_;
+		std::vector<uint8> jpeg_;
+
+		// copies count RGB pixels to (x, y), clipped to the canvas
+		void DrawRow(int x, int y, const uint8* rgb, int count);
+
 		class ParseError : public std::runtime_error
 		{
 		public:
@@ -136,6 +163,47 @@ namespace atque
 		std::string why_unparsed_;
 	};
 
+	// pictures decoded once for every resource, in every scenario
+	// opened, with the same bytes; the most recently used ones stay
+	// decoded, the rest last as long as something else holds them
+	class PICTCache
+	{
+	public:
+		PICTCache() : capacity_(kDefaultCapacity) { }
+		static PICTCache& Shared();
+
+		// null if the picture can't be decoded
+		std::shared_ptr<PICTResource> Load(bool raw, const marathon::ChunkData& data, const marathon::ChunkData& clut);
+
+		void SetCapacity(std::size_t capacity);
+
+	private:
+		enum { kDefaultCapacity = 16 };
+
+		typedef std::tuple<bool, std::uint64_t, std::size_t> Key;
+
+		// the resource handles are kept, not copies of the bytes, so a
+		// hash collision is a miss, not the wrong picture; the last
+		// capacity failed decodes are remembered too
+		struct Entry
+		{
+			marathon::ChunkData data;
+			marathon::ChunkData clut;
+			std::weak_ptr<PICTResource> pict;
+			bool failed;
+
+			bool Matches(marathon::ByteView data, marathon::ByteView clut) const;
+		};
+
+		std::map<Key, Entry> pictures_;
+		std::list<std::shared_ptr<PICTResource>> recent_;
+		std::list<Key> failed_; // newest first
+		std::size_t capacity_;
+		std::mutex mutex_;
+
+		void Touch(const std::shared_ptr<PICTResource>& pict);
+		void Fail(const Key& key);
+	};
 }
 
 #endif
@@ -29,9 +29,9 @@ using namespace atque;
 
 static const int kBufferSize = 8192;
 
-bool SndResource::Load(const std::vector<uint8>& data)
+bool SndResource::Load(marathon::ByteView data)
 {
-	AIStreamBE stream(&data[0], data.size());
+	AIStreamBE stream(data.data(), data.size());
 	uint16 format;
 	stream >> format;
 	if (format != 1 && format != 2)
@@ -60,7 +60,7 @@ bool SndResource::Load(const std::vector<uint8>& data)
 
 		if (cmd == 0x8051)
 		{
-			AIStreamBE sample(&data[param2], data.size() - param2);
+			AIStreamBE sample(data.data() + param2, data.size() - param2);
 			if (data[param2 + 20] == 0x00)
 			{
 				return UnpackStandardSystem7Header(sample);
@@ -21,6 +21,7 @@
 #ifndef SND_RESOURCE_H
 #define SND_RESOURCE_H
 
+#include "ferro/ChunkData.h"
 #include "ferro/cstypes.h"
 
 #include <string>
@@ -34,8 +35,8 @@ namespace atque
 	{
 	public:
 		SndResource() { }
-		SndResource(const std::vector<uint8>& data) { Load(data); }
-		bool Load(const std::vector<uint8>&);
+		SndResource(marathon::ByteView data) { Load(data); }
+		bool Load(marathon::ByteView);
 		std::vector<uint8> Save() const;
 
 		void Export(const std::string& path) const;
@@ -4,6 +4,7 @@
 #include "termview.h"
 #include "split.h"
 #include "merge.h"
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -19,7 +20,10 @@ AtqueWindow::AtqueWindow(wxWindow* parent, int id, const wxString& title, const
 #if defined(__WIN32__) || (defined(__APPLE__) && defined(__MACH__))
 		| wxSIMPLE_BORDER
 #endif
-		)
+		),
+	cancelSplit(false),
+	alive(std::make_shared<bool>(true)),
+	splitProgress(nullptr)
 {
     // begin wxGlade: AtqueWindow::AtqueWindow
     panel_1 = new wxPanel(this, wxID_ANY);
@@ -41,6 +45,17 @@ AtqueWindow::AtqueWindow(wxWindow* parent, int id, const wxString& title, const
     instructions->SetDropTarget(new AtqueDnD(this));
 }
 
+AtqueWindow::~AtqueWindow()
+{
+	// once the worker is gone nothing new is queued; drop what is,
+	// and anything that still runs sees the window is dead
+	cancelSplit = true;
+	if (splitter.joinable())
+		splitter.join();
+	*alive = false;
+	DeletePendingEvents();
+}
+
 
 BEGIN_EVENT_TABLE(AtqueWindow, wxFrame)
     // begin wxGlade: AtqueWindow::event_table
@@ -87,34 +102,156 @@ void AtqueWindow::OnExit(wxCommandEvent &event)
 
 // wxGlade: add AtqueWindow event handlers
 
-void AtqueWindow::Split(const wxString& file)
+namespace
 {
-    // find the split destination
-    wxConfig config;
-    wxString Directory;
-	std::stringstream log;
-
-	try
+	void LogLines(const std::string& log)
 	{
-		atque::Resources* rsrc = new atque::Resources;
-		atque::split(*rsrc, std::string(file.mb_str(wxConvUTF8)), std::string(""), log);
-		
-		log.seekg(0);
+		std::istringstream lines(log);
 		std::string line;
-		while (getline(log, line))
+		while (getline(lines, line))
 		{
 			wxLogMessage(wxString(line.c_str(), wxConvUTF8));
 		}
-		std::vector<wxString> ls;
-		for(int i= 0; i < rsrc->levels.size(); ++i ) {
-			ls.push_back( rsrc->levels[i].name );
+	}
+
+	// hands split's progress, and its log as it's written, to the
+	// window, on the GUI thread
+	class SplitReporter : public atque::SplitProgress
+	{
+	public:
+		SplitReporter(AtqueWindow* window, std::stringstream& log, const std::atomic<bool>& cancel, const std::shared_ptr<bool>& alive) : window_(window), log_(log), cancel_(cancel), alive_(alive) { }
+
+		void Started(atque::Resources& rsrc) override
+		{
+			// the viewer takes the pictures and texts; level pages
+			// are moved over one at a time as they're decoded
+			auto shown = std::make_shared<atque::Resources>();
+			shown->picts = std::move(rsrc.picts);
+			shown->texts = std::move(rsrc.texts);
+			shown->converter = rsrc.converter;
+			shown->level_nums = rsrc.level_nums;
+			shown->level_names = rsrc.level_names;
+			shown->level_terminals.resize(rsrc.level_terminals.size());
+
+			AtqueWindow* window = window_;
+			std::shared_ptr<bool> alive = alive_;
+			window->CallAfter([window, alive, shown]() { if (*alive) window->SplitStarted(shown); });
+		}
+
+		bool LevelDone(atque::Resources& rsrc, std::size_t index, const atque::SplitCounts& counts) override
+		{
+			std::string lines = log_.str();
+			log_.str("");
+
+			AtqueWindow* window = window_;
+			std::shared_ptr<atque::LevelTerminals> terminals = std::make_shared<atque::LevelTerminals>(std::move(rsrc.level_terminals[index]));
+			std::shared_ptr<bool> alive = alive_;
+			window->CallAfter([window, alive, index, terminals, counts, lines]() { if (*alive) window->SplitLevelDone(index, terminals, counts, lines); });
+			return !cancel_;
+		}
+
+	private:
+		AtqueWindow* window_;
+		std::stringstream& log_;
+		const std::atomic<bool>& cancel_;
+		std::shared_ptr<bool> alive_;
+	};
+}
+
+// split runs on its own thread, so the window keeps responding while
+// a big scenario is decoded
+void AtqueWindow::Split(const wxString& file)
+{
+	if (splitter.joinable())
+	{
+		wxLogMessage(wxT("Split failed: already splitting a file"));
+		return;
+	}
+
+	cancelSplit = false;
+	std::string path(file.mb_str(wxConvUTF8));
+	splitter = std::thread([this, path]() {
+		std::stringstream log;
+		SplitReporter reporter(this, log, cancelSplit, alive);
+		atque::Resources rsrc;
+		std::string error;
+		bool cancelled = false;
+		try
+		{
+			atque::split(rsrc, path, log, 0, &reporter);
+		}
+		catch (const atque::split_cancelled&)
+		{
+			cancelled = true;
+		}
+		catch (const std::exception& e)
+		{
+			error = e.what();
 		}
-		TermView* tv = new TermView(rsrc, ls);
-		tv->Show( true );
+
+		std::string lines = log.str();
+		std::shared_ptr<bool> alive = this->alive;
+		CallAfter([this, alive, error, cancelled, lines]() { if (*alive) SplitFinished(error, cancelled, lines); });
+	});
+}
+
+// the levels are known but not decoded yet; they fill in as they are
+void AtqueWindow::SplitStarted(std::shared_ptr<atque::Resources> rsrc)
+{
+	std::vector<wxString> ls;
+	for(int i= 0; i < rsrc->level_names.size(); ++i ) {
+		ls.push_back( rsrc->level_names[i] );
+	}
+	TermView* view = new TermView(rsrc, ls);
+	view->Show( true );
+	splitView = view;
+
+	splitProgress = new wxProgressDialog(wxT("Splitting"), wxT("Decoding levels..."), std::max<int>(1, rsrc->level_names.size()), this, wxPD_CAN_ABORT | wxPD_AUTO_HIDE | wxPD_ELAPSED_TIME);
+}
+
+void AtqueWindow::SplitLevelDone(std::size_t index, std::shared_ptr<atque::LevelTerminals> terminals, const atque::SplitCounts& counts, const std::string& log)
+{
+	LogLines(log);
+
+	TermView* view = static_cast<TermView*>(splitView.get());
+	if (view)
+	{
+		view->rsrc->level_terminals[index] = std::move(*terminals);
+		view->levelDecoded(index);
+	}
+	else
+	{
+		// nobody left to show the rest to
+		cancelSplit = true;
+	}
+
+	if (splitProgress && !splitProgress->Update(counts.levels_done, wxString::Format(wxT("Decoded %d of %d levels (%d of %d KB)"), static_cast<int>(counts.levels_done), static_cast<int>(counts.levels), static_cast<int>((counts.bytes_done + 1023) / 1024), static_cast<int>((counts.bytes + 1023) / 1024))))
+	{
+		cancelSplit = true;
+	}
+}
+
+void AtqueWindow::SplitFinished(const std::string& error, bool cancelled, const std::string& log)
+{
+	splitter.join();
+	if (splitProgress)
+	{
+		splitProgress->Destroy();
+		splitProgress = nullptr;
+	}
+
+	LogLines(log);
+
+	if (cancelled)
+	{
+		// the levels decoded so far stay up
+		wxLogMessage(wxT("Split cancelled"));
 	}
-	catch (const atque::split_error& e)
+	else if (!error.empty())
 	{
-		wxLogMessage(wxT("Split failed: " + wxString(e.what(), wxConvUTF8)));
+		if (splitView)
+			splitView->Close();
+		wxLogMessage(wxT("Split failed: " + wxString(error.c_str(), wxConvUTF8)));
 	}
 }
 
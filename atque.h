@@ -2,6 +2,13 @@
 
 #include <wx/wx.h>
 #include <wx/image.h>
+#include <wx/progdlg.h>
+#include <wx/weakref.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include "split.h"
 #ifdef wxUSE_DRAG_AND_DROP
 #include <wx/dnd.h>
 #endif
@@ -26,6 +33,7 @@ public:
     // end wxGlade
 
     AtqueWindow(wxWindow* parent, int id, const wxString& title, const wxPoint& pos=wxDefaultPosition, const wxSize& size=wxDefaultSize, long style=wxDEFAULT_FRAME_STYLE);
+	~AtqueWindow();
 
 private:
     // begin wxGlade: AtqueWindow::methods
@@ -41,6 +49,13 @@ protected:
     // end wxGlade
 	wxFrame* tv;
 
+	// the split running in the background, if any
+	std::thread splitter;
+	std::atomic<bool> cancelSplit;
+	std::shared_ptr<bool> alive; // checked by the split's queued callbacks
+	wxProgressDialog* splitProgress;
+	wxWeakRef<wxFrame> splitView;
+
     DECLARE_EVENT_TABLE();
 
 public:
@@ -49,6 +64,11 @@ public:
     virtual void OnView2(wxCommandEvent &event); // wxGlade: <event_handler>
     virtual void OnExit(wxCommandEvent &event); // wxGlade: <event_handler>
     virtual void Split(const wxString& file);
+
+	// called on the GUI thread as the background split goes
+	void SplitStarted(std::shared_ptr<atque::Resources> rsrc);
+	void SplitLevelDone(std::size_t index, std::shared_ptr<atque::LevelTerminals> terminals, const atque::SplitCounts& counts, const std::string& log);
+	void SplitFinished(const std::string& error, bool cancelled, const std::string& log);
 }; // wxGlade: end class
 
 #if wxUSE_DRAG_AND_DROP
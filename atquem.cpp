@@ -18,26 +18,46 @@
    
 */
 
+#include <cstdlib>
 #include <iostream>
 #include <string>
 #include <vector>
 
+#include "filesystem.h"
 #include "merge.h"
 
 int main(int argc, char *argv[])
 {
+	int jobs = 0;
+	if (argc == 5 && std::string(argv[1]) == "-j")
+	{
+		jobs = atoi(argv[2]);
+		argv += 2;
+		argc -= 2;
+	}
+
 	if (argc != 3)
 	{
-		std::cerr << "Usage: atquem <source> <dest>" << std::endl;
+		std::cerr << "Usage: atquem [-j jobs] <source> <dest | ->" << std::endl;
 		return 1;
 	}
 
 	try {
-		atque::merge(argv[1], argv[2], std::cout);
+		if (std::string(argv[2]) == "-")
+		{
+			// the scenario goes to stdout, so the log can't
+			std::string name = fs::basename(fs::path(argv[1]).filename());
+			atque::merge(argv[1], std::cout, name, std::cerr, jobs);
+		}
+		else
+		{
+			atque::merge(argv[1], argv[2], std::cout, jobs);
+		}
 	}
 	catch (const atque::merge_error& e)
 	{
 		std::cerr << "atquem: " << e.what() << std::endl;
+		return 1;
 	}
 
 	return 0;
@@ -18,26 +18,75 @@
    
 */
 
+#include <cstdlib>
 #include <iostream>
+#include <string>
 
 #include "split.h"
+#include "termrender.h"
 
 int main(int argc, char *argv[])
 {
+	int jobs = 0;
+	bool terminals = false;
+	bool rubicon = false;
+	while (argc > 1 && argv[1][0] == '-')
+	{
+		std::string option(argv[1]);
+		if (option == "-j" && argc > 2)
+		{
+			jobs = atoi(argv[2]);
+			++argv;
+			--argc;
+		}
+		else if (option == "-t")
+		{
+			terminals = true;
+		}
+		else if (option == "-r")
+		{
+			rubicon = true;
+		}
+		else
+		{
+			break;
+		}
+		++argv;
+		--argc;
+	}
+
 	if (argc != 3)
 	{
-		std::cerr << "Usage: atques <source> <dest_folder>" << std::endl;
+		std::cerr << "Usage: atques [-j jobs] [-t [-r]] <source> <dest_folder>" << std::endl;
+		std::cerr << "  -t  render every terminal page to dest_folder as PNG" << std::endl;
+		std::cerr << "  -r  use Rubicon terminal colors" << std::endl;
 		return 1;
 	}
 	atque::Resources rsrc;
 	try {
-		atque::split(rsrc, argv[1], argv[2], std::cout);
+		atque::split(rsrc, argv[1], std::cout, jobs);
+		if (terminals)
+		{
+			// no GUI toolkit here, so text is in the built-in font
+			atque::TermRenderer renderer(rsrc, rubicon);
+			atque::render_terminals(rsrc, renderer, argv[2], std::cout, jobs);
+		}
 	}
 	catch (const atque::split_error& e)
 	{
 		std::cerr << "atques: " << e.what() << std::endl;
 		return 1;
 	}
+	catch (const atque::render_error& e)
+	{
+		std::cerr << "atques: " << e.what() << std::endl;
+		return 1;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "atques: " << e.what() << std::endl;
+		return 1;
+	}
 
 	return 0;
 }
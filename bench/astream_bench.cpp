@@ -0,0 +1,76 @@
+/* astream_bench.cpp
+
+   Copyright (C) 2008 by Gregory Smith
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   This license is contained in the file "COPYING", which is included
+   with this source code; it is available online at
+   http://www.gnu.org/licenses/gpl.html
+
+*/
+
+/*
+  Decodes a buffer of big-endian uint16s through AIStreamBE, one
+  element at a time and as one array. Only the public stream interface
+  is used, so the same file builds against older versions of AStream
+*/
+
+#include "ferro/AStream.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+	const uint32 kCount = 32 << 20;
+	const int kPasses = 3;
+
+	double Seconds(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main()
+{
+	std::vector<uint8> buffer(kCount * 2);
+	for (std::size_t i = 0; i < buffer.size(); ++i)
+		buffer[i] = static_cast<uint8>(i * 131);
+
+	std::vector<uint16> values(kCount);
+	uint32 sum = 0;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < kPasses; ++pass)
+	{
+		AIStreamBE stream(&buffer[0], buffer.size());
+		for (uint32 i = 0; i < kCount; ++i)
+			stream >> values[i];
+		sum += values[kCount - 1];
+	}
+	printf("per-element >>: %.0f ms\n", Seconds(start) * 1000);
+
+	start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < kPasses; ++pass)
+	{
+		AIStreamBE stream(&buffer[0], buffer.size());
+		stream.read(&values[0], kCount);
+		sum += values[kCount - 1];
+	}
+	printf("read(T*, n):    %.0f ms\n", Seconds(start) * 1000);
+
+	// keeps the loops from being optimized away
+	volatile uint32 sink = sum;
+	(void) sink;
+	return 0;
+}
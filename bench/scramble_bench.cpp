@@ -0,0 +1,93 @@
+/* scramble_bench.cpp
+
+   Copyright (C) 2008 by Gregory Smith
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   This license is contained in the file "COPYING", which is included
+   with this source code; it is available online at
+   http://www.gnu.org/licenses/gpl.html
+
+*/
+
+/*
+  Scrambles a buffer of terminal text with scramble_terminal_text and
+  with the byte-at-a-time loop it replaced, after checking that both
+  give the same bytes
+*/
+
+#include "ferro/TerminalChunk.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+	const std::size_t kSize = 8 << 20;
+	const int kPasses = 20;
+
+	void ScrambleBytes(uint8* text, std::size_t size)
+	{
+		uint8* p = text;
+		for (std::size_t i = 0; i < size / 4; ++i)
+		{
+			p += 2;
+			*p++ ^= 0xfe;
+			*p++ ^= 0xed;
+		}
+		for (std::size_t i = 0; i < size % 4; ++i)
+			*p++ ^= 0xfe;
+	}
+
+	double Seconds(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main()
+{
+	for (std::size_t size = 1; size < 200; ++size)
+	{
+		std::vector<uint8> a(size);
+		for (std::size_t i = 0; i < size; ++i)
+			a[i] = rand();
+		std::vector<uint8> b = a;
+		ScrambleBytes(&a[0], a.size());
+		marathon::scramble_terminal_text(&b[0], b.size());
+		if (a != b)
+		{
+			printf("mismatch at %zu bytes\n", size);
+			return 1;
+		}
+	}
+
+	std::vector<uint8> text(kSize);
+	for (std::size_t i = 0; i < kSize; ++i)
+		text[i] = rand();
+	double megabytes = static_cast<double>(kSize) * kPasses / (1 << 20);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < kPasses; ++pass)
+		ScrambleBytes(&text[0], text.size());
+	printf("byte loop: %.0f MB/s\n", megabytes / Seconds(start));
+
+	start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < kPasses; ++pass)
+		marathon::scramble_terminal_text(&text[0], text.size());
+	printf("kernel:    %.0f MB/s\n", megabytes / Seconds(start));
+
+	volatile uint8 sink = text[0];
+	(void) sink;
+	return 0;
+}
@@ -0,0 +1,96 @@
+/* wad_bench.cpp
+
+   Copyright (C) 2008 by Gregory Smith
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   This license is contained in the file "COPYING", which is included
+   with this source code; it is available online at
+   http://www.gnu.org/licenses/gpl.html
+
+*/
+
+/*
+  Saves and reloads 200 levels' wads in memory, and looks up every
+  chunk of each; the wads mix chunk tags from the Forge save order
+  with unknown ones, and an empty chunk. Only Wad's public interface
+  is used, so the same file builds against older versions of Wad
+*/
+
+#include "ferro/Wad.h"
+#include "ferro/Wadfile.h"
+
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+	const int kLevels = 200;
+	const int kPasses = 50;
+
+	const uint32 kTags[] = {
+		FOUR_CHARS_TO_INT('N','A','M','E'), FOUR_CHARS_TO_INT('P','N','T','S'),
+		FOUR_CHARS_TO_INT('L','I','N','S'), FOUR_CHARS_TO_INT('P','O','L','Y'),
+		FOUR_CHARS_TO_INT('O','B','J','S'), FOUR_CHARS_TO_INT('p','l','a','t'),
+		FOUR_CHARS_TO_INT('t','e','r','m'), FOUR_CHARS_TO_INT('z','z','z','1'),
+		FOUR_CHARS_TO_INT('z','z','z','2'), FOUR_CHARS_TO_INT('a','a','a','1'),
+		FOUR_CHARS_TO_INT('E','P','N','T'), FOUR_CHARS_TO_INT('e','m','p','t')
+	};
+	const int kChunks = sizeof(kTags) / sizeof(kTags[0]);
+
+	double Seconds(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main()
+{
+	std::vector<marathon::Wad> wads(kLevels);
+	for (int level = 0; level < kLevels; ++level)
+	{
+		for (int chunk = kChunks - 1; chunk >= 0; --chunk)
+		{
+			// the last tag is left empty
+			std::vector<uint8> data(chunk == kChunks - 1 ? 0 : 64 + (level * 7 + chunk * 13) % 256);
+			for (std::size_t i = 0; i < data.size(); ++i)
+				data[i] = static_cast<uint8>(level + chunk + i);
+			wads[level].AddChunk(kTags[chunk], data);
+		}
+	}
+
+	std::size_t bytes = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < kPasses; ++pass)
+	{
+		for (int level = 0; level < kLevels; ++level)
+		{
+			std::ostringstream saved;
+			marathon::crc_ostream crc(saved);
+			wads[level].Save(crc);
+
+			std::istringstream stream(saved.str());
+			stream.exceptions(std::ios::failbit | std::ios::badbit);
+			marathon::Wad loaded;
+			loaded.Load(stream, marathon::Wad::kEntryHeaderSize);
+			for (int chunk = 0; chunk < kChunks; ++chunk)
+			{
+				if (loaded.HasChunk(kTags[chunk]))
+					bytes += loaded.GetChunk(kTags[chunk]).size();
+			}
+		}
+	}
+	printf("%d saves, loads and lookups of %d wads: %.0f ms (%zu bytes)\n", kPasses, kLevels, Seconds(start) * 1000, bytes);
+
+	return 0;
+}
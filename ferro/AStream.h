@@ -24,6 +24,7 @@
 #define __ASTREAM_H
 
 #include <string>
+#include <string.h>
 #include <exception>
 #include <iostream>
 #include "ferro/cstypes.h"
@@ -52,6 +53,55 @@ private:
     char * _M_name;
 };
 
+/* Byte order policies; compilers turn these into (vectorized) byte
+   swapping loads and stores */
+
+struct big_endian
+{
+    static uint16 get16(const uint8* __p) {
+        return uint16((uint16(__p[0]) << 8) | __p[1]);
+    }
+
+    static uint32 get32(const uint8* __p) {
+        return (uint32(__p[0]) << 24) | (uint32(__p[1]) << 16) | (uint32(__p[2]) << 8) | uint32(__p[3]);
+    }
+
+    static void put16(uint8* __p, uint16 __value) {
+        __p[0] = uint8(__value >> 8);
+        __p[1] = uint8(__value);
+    }
+
+    static void put32(uint8* __p, uint32 __value) {
+        __p[0] = uint8(__value >> 24);
+        __p[1] = uint8(__value >> 16);
+        __p[2] = uint8(__value >> 8);
+        __p[3] = uint8(__value);
+    }
+};
+
+struct little_endian
+{
+    static uint16 get16(const uint8* __p) {
+        return uint16((uint16(__p[1]) << 8) | __p[0]);
+    }
+
+    static uint32 get32(const uint8* __p) {
+        return (uint32(__p[3]) << 24) | (uint32(__p[2]) << 16) | (uint32(__p[1]) << 8) | uint32(__p[0]);
+    }
+
+    static void put16(uint8* __p, uint16 __value) {
+        __p[0] = uint8(__value);
+        __p[1] = uint8(__value >> 8);
+    }
+
+    static void put32(uint8* __p, uint32 __value) {
+        __p[0] = uint8(__value);
+        __p[1] = uint8(__value >> 8);
+        __p[2] = uint8(__value >> 16);
+        __p[3] = uint8(__value >> 24);
+    }
+};
+
 template <typename T>
 class basic_astream
 {
@@ -63,7 +113,31 @@ private:
 protected:
     T *_M_stream_pos;
     
-    bool  bound_check(uint32 __delta);
+    bool bound_check(uint32 __delta) {
+        if (_M_stream_pos > _M_stream_end || uint32(_M_stream_end - _M_stream_pos) < __delta)
+        {
+            this->setstate(failbit);
+            if ((this->exceptions() & failbit) != 0)
+            {
+                throw failure("serialization bound check failed");
+            }
+        }
+        return !(this->fail());
+    }
+
+    // checks room for __count elements of __size bytes without
+    // computing __count * __size, which can wrap
+    bool bound_check(uint32 __count, uint32 __size) {
+        if (_M_stream_pos > _M_stream_end || uint32(_M_stream_end - _M_stream_pos) / __size < __count)
+        {
+            this->setstate(failbit);
+            if ((this->exceptions() & failbit) != 0)
+            {
+                throw failure("serialization bound check failed");
+            }
+        }
+        return !(this->fail());
+    }
 		
     uint32 tell_pos() const { return _M_stream_pos - _M_stream_begin; } 
     uint32 max_pos() const { return _M_stream_end - _M_stream_begin; }
@@ -94,170 +168,224 @@ public:
             this->setstate(badbit);
         }
     }
-
-    virtual ~basic_astream() {};
 };
 }
 
 /* Input Streams, deserializing */
 
-class AIStream : public AStream::basic_astream<const uint8>
+template <class Endian>
+class basic_aistream : public AStream::basic_astream<const uint8>
 {
 public:
-    AIStream(const uint8* __stream, uint32 __length, uint32 __offset) :
+    basic_aistream(const uint8* __stream, uint32 __length, uint32 __offset) :
         AStream::basic_astream<const uint8>(__stream, __length, __offset) {}
 
     uint32 tellg() const { return this->tell_pos(); }
     uint32 maxg() const { return this->max_pos(); }
     
-    AIStream& operator>>(uint8 &__value);
-    AIStream& operator>>(int8 &__value);
-
-    virtual AIStream& operator>>(uint16 &__value) = 0;
-    virtual AIStream& operator>>(int16 &__value) = 0;
-    virtual AIStream& operator>>(uint32 &__value) = 0;
-    virtual AIStream& operator>>(int32 &__value) = 0;
+    basic_aistream& operator>>(uint8 &__value) { return get(__value); }
+    basic_aistream& operator>>(int8 &__value) { return get(__value); }
+    basic_aistream& operator>>(uint16 &__value) { return get(__value); }
+    basic_aistream& operator>>(int16 &__value) { return get(__value); }
+    basic_aistream& operator>>(uint32 &__value) { return get(__value); }
+    basic_aistream& operator>>(int32 &__value) { return get(__value); }
+
+    basic_aistream& read(char *__ptr, uint32 __count) {
+        if (this->bound_check(__count))
+        {
+            memcpy(__ptr, _M_stream_pos, __count);
+            _M_stream_pos += __count;
+        }
+        return *this;
+    }
 
-    AIStream& read(char *__ptr, uint32 __count);
-    AIStream& read(unsigned char * __ptr, uint32 __count) {
+    basic_aistream& read(unsigned char * __ptr, uint32 __count) {
         return read((char *) __ptr, __count);
     }
 	
-    AIStream& read(signed char * __ptr, uint32 __count) {
+    basic_aistream& read(signed char * __ptr, uint32 __count) {
         return read((char *) __ptr, __count);
     }
+
+    basic_aistream& read(uint16 *__ptr, uint32 __count) { return read_array(__ptr, __count); }
+    basic_aistream& read(int16 *__ptr, uint32 __count) { return read_array(__ptr, __count); }
+    basic_aistream& read(uint32 *__ptr, uint32 __count) { return read_array(__ptr, __count); }
+    basic_aistream& read(int32 *__ptr, uint32 __count) { return read_array(__ptr, __count); }
 	
-    AIStream& ignore(uint32 __count);
+    basic_aistream& ignore(uint32 __count) {
+        if (this->bound_check(__count))
+        {
+            _M_stream_pos += __count;
+        }
+        return *this;
+    }
 
     // Uses >> instead of operator>> so as to pick up friendly operator>>
     template<class T>
-    inline AIStream& read(T* __list, uint32 __count) {
+    inline basic_aistream& read(T* __list, uint32 __count) {
         T* ValuePtr = __list;
         for (unsigned int k=0; k<__count; k++)
             *this >> *(ValuePtr++);
         
         return *this;
     };
+
+    // checks bounds once for the whole array, then decodes it in one
+    // loop
+    template<class T>
+    basic_aistream& read_array(T* __list, uint32 __count) {
+        if (this->bound_check(__count, sizeof(T)))
+        {
+            const uint8* __p = _M_stream_pos;
+            for (uint32 k = 0; k < __count; ++k)
+                decode(__p + k * sizeof(T), __list[k]);
+            _M_stream_pos += __count * sizeof(T);
+        }
+        return *this;
+    }
+
+private:
+    static void decode(const uint8* __p, uint8& __value) { __value = *__p; }
+    static void decode(const uint8* __p, int8& __value) { __value = int8(*__p); }
+    static void decode(const uint8* __p, uint16& __value) { __value = Endian::get16(__p); }
+    static void decode(const uint8* __p, int16& __value) { __value = int16(Endian::get16(__p)); }
+    static void decode(const uint8* __p, uint32& __value) { __value = Endian::get32(__p); }
+    static void decode(const uint8* __p, int32& __value) { __value = int32(Endian::get32(__p)); }
+
+    // a read past the end gives 0, so every path stores to __value
+    template<class T>
+    basic_aistream& get(T& __value) {
+        if (this->bound_check(sizeof(T)))
+        {
+            decode(_M_stream_pos, __value);
+            _M_stream_pos += sizeof(T);
+        }
+        else
+        {
+            __value = T();
+        }
+        return *this;
+    }
 };
 
-class AIStreamBE : public AIStream
+class AIStreamBE : public basic_aistream<AStream::big_endian>
 {
 public:
     AIStreamBE(const uint8* __stream, uint32 __length, uint32 __offset = 0) :
-        AIStream(__stream, __length, __offset) {};
-
-    AIStream& operator>>(uint8 &__value) {
-        return AIStream::operator>>(__value);
-    }
-
-    AIStream& operator>>(int8 &__value) {
-        return AIStream::operator>>(__value);
-    }
-	
-    AIStream& operator>>(uint16 &__value);
-    AIStream& operator>>(int16 &__value);
-    AIStream& operator>>(uint32 &__value);
-    AIStream& operator>>(int32 &__value);
+        basic_aistream<AStream::big_endian>(__stream, __length, __offset) {};
 };
 
-class AIStreamLE : public AIStream
+class AIStreamLE : public basic_aistream<AStream::little_endian>
 {
 public:
     AIStreamLE(const uint8* __stream, uint32 __length, uint32 __offset = 0) :
-        AIStream(__stream, __length, __offset) {};
-
-    AIStream& operator>>(uint8 &__value) {
-        return AIStream::operator>>(__value);
-    }
-
-    AIStream& operator>>(int8 &__value) {
-        return AIStream::operator>>(__value);
-    }
-
-    AIStream& operator>>(uint16 &__value);
-    AIStream& operator>>(int16 &__value);
-    AIStream& operator>>(uint32 &__value);
-    AIStream& operator>>(int32 &__value);
+        basic_aistream<AStream::little_endian>(__stream, __length, __offset) {};
 };
 
 /* Output Streams, serializing */
 
-class AOStream : public AStream::basic_astream<uint8>
+template <class Endian>
+class basic_aostream : public AStream::basic_astream<uint8>
 {
 public:
-    AOStream(uint8* __stream, uint32 __length, uint32 __offset) :
+    basic_aostream(uint8* __stream, uint32 __length, uint32 __offset) :
         AStream::basic_astream<uint8>(__stream, __length, __offset) {}
 
     uint32 tellp() const { return this->tell_pos(); }
     uint32 maxp() const { return this->max_pos(); }
 		
-    AOStream& operator<<(uint8 __value);
-    AOStream& operator<<(int8 __value);
-    virtual AOStream& operator<<(uint16 __value) = 0;
-    virtual AOStream& operator<<(int16 __value) = 0;
-    virtual AOStream& operator<<(uint32 __value) = 0;
-    virtual AOStream& operator<<(int32 __value) = 0;
-
-    AOStream& write(const char *__ptr, uint32 __count);
-    AOStream& write(const unsigned char * __ptr, uint32 __count) {
+    basic_aostream& operator<<(uint8 __value) { return put(__value); }
+    basic_aostream& operator<<(int8 __value) { return put(__value); }
+    basic_aostream& operator<<(uint16 __value) { return put(__value); }
+    basic_aostream& operator<<(int16 __value) { return put(__value); }
+    basic_aostream& operator<<(uint32 __value) { return put(__value); }
+    basic_aostream& operator<<(int32 __value) { return put(__value); }
+
+    basic_aostream& write(const char *__ptr, uint32 __count) {
+        if (this->bound_check(__count))
+        {
+            memcpy(_M_stream_pos, __ptr, __count);
+            _M_stream_pos += __count;
+        }
+        return *this;
+    }
+
+    basic_aostream& write(const unsigned char * __ptr, uint32 __count) {
         return write((char *) __ptr, __count);
     }
 	
-    AOStream& write(const signed char * __ptr, uint32 __count) {
+    basic_aostream& write(const signed char * __ptr, uint32 __count) {
         return write((char *) __ptr, __count);
     }
+
+    basic_aostream& write(const uint16 *__ptr, uint32 __count) { return write_array(__ptr, __count); }
+    basic_aostream& write(const int16 *__ptr, uint32 __count) { return write_array(__ptr, __count); }
+    basic_aostream& write(const uint32 *__ptr, uint32 __count) { return write_array(__ptr, __count); }
+    basic_aostream& write(const int32 *__ptr, uint32 __count) { return write_array(__ptr, __count); }
 	
-    AOStream& ignore(uint32 __count);
+    basic_aostream& ignore(uint32 __count) {
+        if (this->bound_check(__count))
+        {
+            _M_stream_pos += __count;
+        }
+        return *this;
+    }
 
     // Uses << instead of operator<< so as to pick up friendly operator<<
     template<class T>
-    inline AOStream& write(const T* __list, uint32 __count) {
-        T* ValuePtr = __list;
+    inline basic_aostream& write(const T* __list, uint32 __count) {
+        const T* ValuePtr = __list;
         for (unsigned int k=0; k<__count; k++)
             *this << *(ValuePtr++);
         
         return *this;
     }
+
+    // checks bounds once for the whole array, then encodes it in one
+    // loop
+    template<class T>
+    basic_aostream& write_array(const T* __list, uint32 __count) {
+        if (this->bound_check(__count, sizeof(T)))
+        {
+            uint8* __p = _M_stream_pos;
+            for (uint32 k = 0; k < __count; ++k)
+                encode(__p + k * sizeof(T), __list[k]);
+            _M_stream_pos += __count * sizeof(T);
+        }
+        return *this;
+    }
+
+private:
+    static void encode(uint8* __p, uint8 __value) { *__p = __value; }
+    static void encode(uint8* __p, int8 __value) { *__p = uint8(__value); }
+    static void encode(uint8* __p, uint16 __value) { Endian::put16(__p, __value); }
+    static void encode(uint8* __p, int16 __value) { Endian::put16(__p, uint16(__value)); }
+    static void encode(uint8* __p, uint32 __value) { Endian::put32(__p, __value); }
+    static void encode(uint8* __p, int32 __value) { Endian::put32(__p, uint32(__value)); }
+
+    template<class T>
+    basic_aostream& put(T __value) {
+        if (this->bound_check(sizeof(T)))
+        {
+            encode(_M_stream_pos, __value);
+            _M_stream_pos += sizeof(T);
+        }
+        return *this;
+    }
 };
 
-class AOStreamBE: public AOStream
+class AOStreamBE : public basic_aostream<AStream::big_endian>
 {
 public:
     AOStreamBE(uint8* __stream, uint32 __length, uint32 __offset = 0) :
-        AOStream(__stream, __length, __offset) {};
-
-    AOStream& operator<<(uint8 __value) {
-        return AOStream::operator<<(__value);
-    }
-    
-    AOStream& operator<<(int8 __value) {
-        return AOStream::operator<<(__value);
-    }
-    
-    AOStream& operator<<(uint16 __value);
-    AOStream& operator<<(int16 __value);
-    AOStream& operator<<(uint32 __value);
-    AOStream& operator<<(int32 __value);
+        basic_aostream<AStream::big_endian>(__stream, __length, __offset) {};
 };
 
-class AOStreamLE: public AOStream
+class AOStreamLE : public basic_aostream<AStream::little_endian>
 {
 public:
     AOStreamLE(uint8* __stream, uint32 __length, uint32 __offset = 0) :
-        AOStream(__stream, __length, __offset) {}
-
-    AOStream& operator<<(uint8 __value) {
-        return AOStream::operator<<(__value);
-    }
-
-    AOStream& operator<<(int8 __value) {
-        return AOStream::operator<<(__value);
-    }
- 
-    AOStream& operator<<(uint16 __value);
-    AOStream& operator<<(int16 __value);
-    AOStream& operator<<(uint32 __value);
-    AOStream& operator<<(int32 __value);
+        basic_aostream<AStream::little_endian>(__stream, __length, __offset) {}
 };
 
 #endif
@@ -0,0 +1,115 @@
+/* ChunkData.h
+
+   Copyright (C) 2008 by Gregory Smith
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   This license is contained in the file "COPYING", which is included
+   with this source code; it is available online at
+   http://www.gnu.org/licenses/gpl.html
+
+*/
+
+/* Chunk and resource payloads: owned, borrowed from a mapped file, or
+   read from a file on first use */
+
+#ifndef CHUNKDATA_H
+#define CHUNKDATA_H
+
+#include "ferro/cstypes.h"
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace marathon
+{
+	class MappedFile;
+
+	// non-owning view of a run of bytes
+	class ByteView
+	{
+	public:
+		ByteView() : data_(0), size_(0) { }
+		ByteView(const uint8* data, std::size_t size) : data_(data), size_(size) { }
+		ByteView(const std::vector<uint8>& v) : data_(v.empty() ? 0 : &v[0]), size_(v.size()) { }
+
+		const uint8* data() const { return data_; }
+		std::size_t size() const { return size_; }
+		bool empty() const { return size_ == 0; }
+
+		const uint8* begin() const { return data_; }
+		const uint8* end() const { return data_ + size_; }
+		const uint8& operator[](std::size_t i) const { return data_[i]; }
+
+		std::vector<uint8> copy() const { return std::vector<uint8>(begin(), end()); }
+
+	private:
+		const uint8* data_;
+		std::size_t size_;
+	};
+
+	// reads chunk payloads from a file when they are first asked for
+	class ChunkReader
+	{
+	public:
+		virtual ~ChunkReader() { }
+		virtual std::vector<uint8> Read(std::size_t offset, std::size_t length) const = 0;
+	};
+
+	class ChunkData
+	{
+	public:
+		ChunkData() { }
+		ChunkData(const std::vector<uint8>& data) : data_(data) { }
+		ChunkData(std::vector<uint8>&& data) : data_(std::move(data)) { }
+		ChunkData(ByteView data) : data_(data.begin(), data.end()) { }
+
+		// borrows bytes from file, which stays mapped as long as any
+		// chunk refers to it
+		ChunkData(const std::shared_ptr<const MappedFile>& file, ByteView view) : file_(file), view_(view) { }
+
+		// nothing is read until the first call to view(); copies share
+		// the bytes once they are read
+		ChunkData(const std::shared_ptr<const ChunkReader>& reader, std::size_t offset, std::size_t length) : deferred_(std::make_shared<Deferred>(reader, offset, length)) { }
+
+		ByteView view() const { return deferred_ ? deferred_->view() : file_ ? view_ : ByteView(data_); }
+		std::size_t size() const { return deferred_ ? deferred_->length : file_ ? view_.size() : data_.size(); }
+		bool mapped() const { return static_cast<bool>(file_); }
+
+	private:
+		std::vector<uint8> data_;
+		std::shared_ptr<const MappedFile> file_;
+		ByteView view_;
+
+		struct Deferred
+		{
+			Deferred(const std::shared_ptr<const ChunkReader>& reader, std::size_t offset, std::size_t length) : reader(reader), offset(offset), length(length) { }
+
+			ByteView view()
+			{
+				std::call_once(read, [this]() { data = reader->Read(offset, length); reader.reset(); });
+				return ByteView(data);
+			}
+
+			std::shared_ptr<const ChunkReader> reader;
+			std::size_t offset;
+			std::size_t length;
+			std::once_flag read;
+			std::vector<uint8> data;
+		};
+		std::shared_ptr<Deferred> deferred_;
+	};
+}
+
+#endif
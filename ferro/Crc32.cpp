@@ -0,0 +1,182 @@
+/* Crc32.cpp
+
+   Copyright (C) 2008 by Gregory Smith
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   This license is contained in the file "COPYING", which is included
+   with this source code; it is available online at
+   http://www.gnu.org/licenses/gpl.html
+
+*/
+
+#include "ferro/Crc32.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace marathon;
+
+namespace
+{
+	const uint32 kPolynomial = 0xedb88320;
+
+	// table[k][b] is the CRC of byte b followed by k zero bytes, so
+	// eight bytes can be looked up at once ("slicing-by-8")
+	struct CrcTables
+	{
+		uint32 table[8][256];
+
+		CrcTables()
+		{
+			for (int b = 0; b < 256; ++b)
+			{
+				uint32 crc = b;
+				for (int bit = 0; bit < 8; ++bit)
+					crc = (crc & 1) ? (crc >> 1) ^ kPolynomial : crc >> 1;
+				table[0][b] = crc;
+			}
+
+			for (int b = 0; b < 256; ++b)
+			{
+				for (int k = 1; k < 8; ++k)
+					table[k][b] = (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xff];
+			}
+		}
+	};
+
+	const CrcTables tables;
+
+	// blocks smaller than this aren't worth a thread
+	const std::size_t kMinParallelBlock = 1 << 20;
+}
+
+void Crc32::process_bytes(const void* data, std::size_t size)
+{
+	const uint8* p = static_cast<const uint8*>(data);
+	const uint32 (&t)[8][256] = tables.table;
+	uint32 crc = crc_;
+
+	// the byte order of the loads doesn't matter, only the order
+	// the bytes are folded in
+	while (size >= 8)
+	{
+		uint32 lo = crc ^ (p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32>(p[3]) << 24);
+		uint32 hi = p[4] | p[5] << 8 | p[6] << 16 | static_cast<uint32>(p[7]) << 24;
+		crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+			t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+		p += 8;
+		size -= 8;
+	}
+
+	while (size--)
+		crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+
+	crc_ = crc;
+}
+
+uint32 marathon::crc32(const void* data, std::size_t size)
+{
+	Crc32 crc;
+	crc.process_bytes(data, size);
+	return crc.checksum();
+}
+
+static uint32 gf2_matrix_times(const uint32* mat, uint32 vec)
+{
+	uint32 sum = 0;
+	while (vec)
+	{
+		if (vec & 1)
+			sum ^= *mat;
+		vec >>= 1;
+		++mat;
+	}
+	return sum;
+}
+
+static void gf2_matrix_square(uint32* square, const uint32* mat)
+{
+	for (int n = 0; n < 32; ++n)
+		square[n] = gf2_matrix_times(mat, mat[n]);
+}
+
+// as in zlib: appends length2 zero bytes to crc1 by repeated squaring
+// of the one-zero-bit operator, then folds in crc2
+uint32 marathon::crc32_combine(uint32 crc1, uint32 crc2, std::size_t length2)
+{
+	if (length2 == 0)
+		return crc1;
+
+	uint32 even[32];
+	uint32 odd[32];
+
+	// operator for one zero bit
+	odd[0] = kPolynomial;
+	uint32 row = 1;
+	for (int n = 1; n < 32; ++n)
+	{
+		odd[n] = row;
+		row <<= 1;
+	}
+
+	// two and then four zero bits
+	gf2_matrix_square(even, odd);
+	gf2_matrix_square(odd, even);
+
+	do {
+		gf2_matrix_square(even, odd);
+		if (length2 & 1)
+			crc1 = gf2_matrix_times(even, crc1);
+		length2 >>= 1;
+
+		if (!length2)
+			break;
+
+		gf2_matrix_square(odd, even);
+		if (length2 & 1)
+			crc1 = gf2_matrix_times(odd, crc1);
+		length2 >>= 1;
+	} while (length2);
+
+	return crc1 ^ crc2;
+}
+
+uint32 marathon::crc32_parallel(const void* data, std::size_t size, int threads)
+{
+	if (threads <= 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	std::size_t blocks = std::min<std::size_t>(threads, size / kMinParallelBlock);
+	if (blocks <= 1)
+		return crc32(data, size);
+
+	const uint8* p = static_cast<const uint8*>(data);
+	std::size_t block_size = (size + blocks - 1) / blocks;
+	std::vector<uint32> crcs(blocks);
+	std::vector<std::thread> workers;
+	for (std::size_t i = 1; i < blocks; ++i)
+	{
+		std::size_t offset = i * block_size;
+		std::size_t length = std::min(block_size, size - offset);
+		workers.push_back(std::thread([&crcs, p, i, offset, length]() { crcs[i] = crc32(p + offset, length); }));
+	}
+	crcs[0] = crc32(p, block_size);
+	for (std::vector<std::thread>::iterator it = workers.begin(); it != workers.end(); ++it)
+		it->join();
+
+	uint32 crc = crcs[0];
+	for (std::size_t i = 1; i < blocks; ++i)
+		crc = crc32_combine(crc, crcs[i], std::min(block_size, size - i * block_size));
+
+	return crc;
+}
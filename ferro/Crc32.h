@@ -0,0 +1,56 @@
+/* Crc32.h
+
+   Copyright (C) 2008 by Gregory Smith
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   This license is contained in the file "COPYING", which is included
+   with this source code; it is available online at
+   http://www.gnu.org/licenses/gpl.html
+
+*/
+
+/* CRC-32 (the zip / wadfile one), eight bytes at a time */
+
+#ifndef CRC32_H
+#define CRC32_H
+
+#include "ferro/cstypes.h"
+
+#include <cstddef>
+
+namespace marathon
+{
+	// same interface as boost::crc_32_type
+	class Crc32
+	{
+	public:
+		Crc32() : crc_(0xffffffff) { }
+
+		void process_bytes(const void* data, std::size_t size);
+		uint32 checksum() const { return crc_ ^ 0xffffffff; }
+
+	private:
+		uint32 crc_;
+	};
+
+	uint32 crc32(const void* data, std::size_t size);
+
+	// the CRC of two blocks one after the other, from the CRC of each
+	// and the length of the second
+	uint32 crc32_combine(uint32 crc1, uint32 crc2, std::size_t length2);
+
+	// splits data into blocks, checksums them on up to threads threads
+	// (all cores if threads <= 0) and combines the results
+	uint32 crc32_parallel(const void* data, std::size_t size, int threads = 0);
+}
+
+#endif
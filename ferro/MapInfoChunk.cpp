@@ -23,9 +23,9 @@
 
 using namespace marathon;
 
-void MapInfo::Load(const std::vector<uint8>& data)
+void MapInfo::Load(ByteView data)
 {
-	AIStreamBE s(&data[0], data.size());
+	AIStreamBE s(data.data(), data.size());
 
 	s >> _environment_code;
 	s >> _physics_model;
@@ -22,6 +22,7 @@
 #define MAPINFOCHUNK_H
 
 #include "cstypes.h"
+#include "ChunkData.h"
 
 #include <string>
 #include <vector>
@@ -35,9 +36,9 @@ namespace marathon
 		enum { kTag = FOUR_CHARS_TO_INT('M','i','n','f') };
 		
 		MapInfo() { }
-		MapInfo(const std::vector<uint8>& data) { Load(data); }
+		MapInfo(ByteView data) { Load(data); }
 		
-		void Load(const std::vector<uint8>&);
+		void Load(ByteView);
 
 		int16 mission_flags() const { return _mission_flags; }
 		int16 environment_flags() const { return _environment_flags; }
@@ -0,0 +1,117 @@
+/* MappedFile.cpp
+
+   Copyright (C) 2008 by Gregory Smith
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   This license is contained in the file "COPYING", which is included
+   with this source code; it is available online at
+   http://www.gnu.org/licenses/gpl.html
+
+*/
+
+#include "ferro/MappedFile.h"
+
+#include <ios>
+
+#ifdef __WIN32__
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace marathon;
+
+bool MappedFile::Open(const std::string& path)
+{
+	Close();
+
+#ifdef __WIN32__
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	size_ = static_cast<std::size_t>(size.QuadPart);
+	if (size_)
+	{
+		HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping)
+		{
+			data_ = static_cast<const uint8*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(file);
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	size_ = st.st_size;
+	if (size_)
+	{
+		void* p = mmap(0, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED)
+			data_ = static_cast<const uint8*>(p);
+	}
+	close(fd);
+#endif
+
+	if (size_ && !data_)
+	{
+		size_ = 0;
+		return false;
+	}
+
+	open_ = true;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data_)
+	{
+#ifdef __WIN32__
+		UnmapViewOfFile(data_);
+#else
+		munmap(const_cast<uint8*>(data_), size_);
+#endif
+	}
+
+	data_ = 0;
+	size_ = 0;
+	open_ = false;
+}
+
+ByteView MappedFile::view(std::size_t offset, std::size_t length) const
+{
+	if (offset > size_ || length > size_ - offset)
+		throw std::ios_base::failure("read past end of mapped file");
+
+	return ByteView(data_ + offset, length);
+}
@@ -0,0 +1,58 @@
+/* MappedFile.h
+
+   Copyright (C) 2008 by Gregory Smith
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   This license is contained in the file "COPYING", which is included
+   with this source code; it is available online at
+   http://www.gnu.org/licenses/gpl.html
+
+*/
+
+/* Read-only memory mapping of a whole file */
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include "ferro/ChunkData.h"
+
+#include <string>
+
+namespace marathon
+{
+	class MappedFile
+	{
+	public:
+		MappedFile() : data_(0), size_(0), open_(false) { }
+		~MappedFile() { Close(); }
+
+		bool Open(const std::string& path);
+		void Close();
+
+		bool is_open() const { return open_; }
+		const uint8* data() const { return data_; }
+		std::size_t size() const { return size_; }
+
+		// throws std::ios_base::failure if the range is outside the file
+		ByteView view(std::size_t offset, std::size_t length) const;
+
+	private:
+		MappedFile(const MappedFile&);
+		MappedFile& operator=(const MappedFile&);
+
+		const uint8* data_;
+		std::size_t size_;
+		bool open_;
+	};
+}
+
+#endif
@@ -38,10 +38,10 @@ struct ScriptHeader
 };
 
 
-void ScriptChunk::Load(const std::vector<uint8>& data)
+void ScriptChunk::Load(ByteView data)
 {
 	scripts_.clear();
-	AIStreamBE stream(&data[0], data.size());
+	AIStreamBE stream(data.data(), data.size());
 
 	uint16 num_scripts;
 	stream >> num_scripts;
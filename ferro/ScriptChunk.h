@@ -22,6 +22,7 @@
 #define SCRIPTCHUNK_H
 
 #include "cstypes.h"
+#include "ChunkData.h"
 
 #include <list>
 #include <string>
@@ -37,9 +38,9 @@ namespace marathon
 		       kLuaTag = FOUR_CHARS_TO_INT('L','U','A','S') };
 
 		ScriptChunk() { }
-		ScriptChunk(const std::vector<uint8>& data) { Load(data); }
+		ScriptChunk(ByteView data) { Load(data); }
 
-		void Load(const std::vector<uint8>&);
+		void Load(ByteView);
 		std::vector<uint8> Save() const;
 
 		struct Script
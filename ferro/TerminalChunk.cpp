@@ -22,10 +22,14 @@
 #include "ferro/macroman.h"
 #include "ferro/TerminalChunk.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 
+#include <stdint.h>
+#include <string.h>
+
 #include <boost/assign.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 
@@ -157,22 +161,43 @@ uint32 TerminalText::GetSize() const
 	return kHeaderSize + (groupings_.size() * TerminalGrouping::kSize) + (font_changes_.size() * FontChange::kSize) + text_.size();
 }
 
-void TerminalText::EncodeText()
+void marathon::scramble_terminal_text(uint8* text, std::size_t size)
 {
-	uint8 *p = &text_[0];
+	// the pattern repeats every four bytes, so sixteen can be done at
+	// once with two 64-bit XORs
+	static const uint8 pattern[8] = { 0, 0, 0xfe, 0xed, 0, 0, 0xfe, 0xed };
+	uint64_t mask;
+	memcpy(&mask, pattern, sizeof(mask));
+
+	uint8* p = text;
+	uint8* groups_end = text + (size & ~static_cast<std::size_t>(3));
+	while (groups_end - p >= 16)
+	{
+		uint64_t a, b;
+		memcpy(&a, p, 8);
+		memcpy(&b, p + 8, 8);
+		a ^= mask;
+		b ^= mask;
+		memcpy(p, &a, 8);
+		memcpy(p + 8, &b, 8);
+		p += 16;
+	}
 
-	for (int i = 0; i < text_.size() / 4; ++i)
+	for (; p != groups_end; p += 4)
 	{
-		p += 2;
-		*p++ ^= 0xfe;
-		*p++ ^= 0xed;
+		p[2] ^= 0xfe;
+		p[3] ^= 0xed;
 	}
 
-	for (int i = 0; i < text_.size() % 4; ++i)
+	for (; p != text + size; ++p)
 	{
-		*p++ ^= 0xfe;
+		*p ^= 0xfe;
 	}
+}
 
+void TerminalText::EncodeText()
+{
+	scramble_terminal_text(text_.data(), text_.size());
 	flags_ |= kTextIsEncoded;
 }
 
@@ -180,7 +205,7 @@ void TerminalText::DecodeText()
 {
 	if (flags_ & kTextIsEncoded)
 	{
-		EncodeText();
+		scramble_terminal_text(text_.data(), text_.size());
 		flags_ &= ~kTextIsEncoded;
 	}
 }
@@ -212,7 +237,7 @@ static std::vector<group_header_data> group_data = boost::assign::list_of<group_
 	("TAG", true ) // permutation is the tag to activate
 	;
 
-static std::string get_line(std::istream& stream)
+static std::string get_line(std::istream& stream, const TextConverter& converter)
 {
 	std::string line;
 	char c;
@@ -235,7 +260,7 @@ static std::string get_line(std::istream& stream)
 
 	};
 
-	return utf8_to_mac_roman(line);
+	return converter.FromUTF8(line);
 }
 
 static int find_group(const std::string& line)
@@ -501,7 +526,7 @@ void TerminalText::CompileGroup(std::vector<std::string>::const_iterator* it, co
 	}
 }
 
-bool TerminalText::Compile(std::istream& stream, int expected_id)
+bool TerminalText::Compile(std::istream& stream, int expected_id, const TextConverter& converter)
 {
 	text_.clear();
 	groupings_.clear();
@@ -513,7 +538,7 @@ bool TerminalText::Compile(std::istream& stream, int expected_id)
 	bool start = false;
 	while (!stream.eof() && !start)
 	{
-		std::string line = get_line(stream);
+		std::string line = get_line(stream, converter);
 		if (algo::starts_with(line, "#TERMINAL"))
 		{
 			std::istringstream s(line);
@@ -539,7 +564,7 @@ bool TerminalText::Compile(std::istream& stream, int expected_id)
 	bool end = false;
 	while (!stream.eof() && !end)
 	{
-		std::string line = get_line(stream);
+		std::string line = get_line(stream, converter);
 		if (algo::starts_with(line, "#ENDTERMINAL"))
 			end = true;
 		else
@@ -570,7 +595,7 @@ bool TerminalText::Compile(std::istream& stream, int expected_id)
 	return true;
 }
 
-void TerminalText::Decompile(std::ostream& stream) const
+void TerminalText::Decompile(std::ostream& stream, const TextConverter& converter) const
 {
 	std::vector<FontChange>::const_iterator font_iterator = font_changes_.begin();
 	for (std::vector<TerminalGrouping>::const_iterator it = groupings_.begin(); it != groupings_.end(); ++it)
@@ -615,19 +640,27 @@ void TerminalText::Decompile(std::ostream& stream) const
 			}
 			else
 			{
-				std::string temp;
-				temp += text_[index];
-				stream << mac_roman_to_utf8(temp);
-				++index;
+				// convert up to the next font change or line break at
+				// once, so two byte characters stay together
+				int run_limit = end;
+				if (font_iterator != font_changes_.end() && font_iterator->index_ > index)
+					run_limit = std::min<int>(end, font_iterator->index_);
+
+				int run_end = index + 1;
+				while (run_end < run_limit && text_[run_end] != '\r' && text_[run_end] != '\0')
+					++run_end;
+
+				stream << converter.ToUTF8(std::string(reinterpret_cast<const char*>(&text_[index]), run_end - index));
+				index = run_end;
 			}
 		}
 	}
 }
 
-void TerminalChunk::Load(const std::vector<uint8>& data)
+void TerminalChunk::Load(ByteView data)
 {
 	terminal_texts_.clear();
-	AIStreamBE stream(&data[0], data.size());
+	AIStreamBE stream(data.data(), data.size());
 
 	while (stream.tellg() < stream.maxg())
 	{
@@ -658,7 +691,7 @@ std::vector<uint8> TerminalChunk::Save() const
 	return v;
 }
 
-void TerminalChunk::Compile(const std::string& path)
+void TerminalChunk::Compile(const std::string& path, const TextConverter& converter)
 {
 	std::ifstream stream(path.c_str());
 
@@ -666,12 +699,12 @@ void TerminalChunk::Compile(const std::string& path)
 	while (!stream.eof())
 	{
 		TerminalText tt;
-		if (tt.Compile(stream, terminal_texts_.size()))
+		if (tt.Compile(stream, terminal_texts_.size(), converter))
 			terminal_texts_.push_back(tt);
 	}
 }
 
-void TerminalChunk::Decompile(const std::string& path) const
+void TerminalChunk::Decompile(const std::string& path, const TextConverter& converter) const
 {
 	std::ofstream stream(path.c_str(), std::ios::out | std::ios::trunc);
 	
@@ -679,7 +712,7 @@ void TerminalChunk::Decompile(const std::string& path) const
 	{
 		stream << ";" << std::endl;
 		stream << "#TERMINAL " << index << std::endl;
-		terminal_texts_[index].Decompile(stream);
+		terminal_texts_[index].Decompile(stream, converter);
 		stream << "#ENDTERMINAL " << index << std::endl;
 	}
 }
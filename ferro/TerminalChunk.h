@@ -22,7 +22,10 @@
 #define TERMINAL_H
 
 #include "ferro/cstypes.h"
+#include "ferro/ChunkData.h"
+#include "ferro/macroman.h"
 
+#include <cstddef>
 #include <stdexcept>
 #include <vector>
 
@@ -95,6 +98,11 @@ struct FontChange
 	int16 face_;
 	int16 color_;
 };
+// terminal text is scrambled by XORing the last two bytes of every
+// four with 0xfe 0xed, and any bytes after the last four with 0xfe;
+// scrambling again undoes it
+void scramble_terminal_text(uint8* text, std::size_t size);
+
 struct TerminalText
 {
 	TerminalText() { }
@@ -112,8 +120,9 @@ struct TerminalText
 	bool IsEncoded() const { return flags_ & kTextIsEncoded; }
 	void DecodeText();
 	
-	bool Compile(std::istream& stream, int expected_id);
-	void Decompile(std::ostream& stream) const;
+	// the script is UTF-8; the converter is for the scenario's text
+	bool Compile(std::istream& stream, int expected_id, const TextConverter& converter);
+	void Decompile(std::ostream& stream, const TextConverter& converter) const;
 	
 	void CompileLine(FontChange* font, const std::string& line);
 	void CompileGroup(std::vector<std::string>::const_iterator* it, const std::vector<std::string>::iterator& end);
@@ -133,7 +142,7 @@ public:
 	enum { kTag = FOUR_CHARS_TO_INT('t','e','r','m') };
 	
 	TerminalChunk() { }
-	TerminalChunk(const std::vector<uint8>& data) { Load(data); }
+	TerminalChunk(ByteView data) { Load(data); }
 	
 	class ParseError : public std::runtime_error
 	{
@@ -141,9 +150,9 @@ public:
 		ParseError(const std::string& what) : std::runtime_error(what) { }
 	};
 	
-	void Load(const std::vector<uint8>&);
-	void Decompile(const std::string& path) const;
-	void Compile(const std::string& path);
+	void Load(ByteView);
+	void Decompile(const std::string& path, const TextConverter& converter) const;
+	void Compile(const std::string& path, const TextConverter& converter);
 	std::vector<uint8> Save() const;
 	
 	std::vector<TerminalText> terminal_texts_;
@@ -20,6 +20,8 @@
 
 #include "AStream.h"
 #include "ferro/MapInfoChunk.h"
+#include "ferro/MappedFile.h"
+#include "ferro/TerminalChunk.h"
 #include "ferro/Unimap.h"
 #include "ferro/macroman.h"
 
@@ -27,18 +29,34 @@
 
 using namespace marathon;
 
-const std::vector<uint8>& Unimap::GetResource(ResourceIdentifier id)
+ByteView Unimap::GetResource(ResourceIdentifier id)
 {
-	if (!resources_[id].size())
+	std::map<ResourceIdentifier, ChunkData>::const_iterator it = resources_.find(id);
+	if (it != resources_.end() && it->second.size())
 	{
-		const Wad& wad = GetWad(id.second);
-		if (wad.HasChunk(id.first))
-		{
-			return wad.GetChunk(id.first);
-		}
+		return it->second.view();
+	}
+	else if (HasWad(id.second))
+	{
+		return GetWad(id.second).GetChunk(id.first);
 	}
 
-	return resources_[id];
+	return ByteView();
+}
+
+ChunkData Unimap::GetResourceData(ResourceIdentifier id)
+{
+	std::map<ResourceIdentifier, ChunkData>::const_iterator it = resources_.find(id);
+	if (it != resources_.end() && it->second.size())
+	{
+		return it->second;
+	}
+	else if (HasWad(id.second))
+	{
+		return GetWad(id.second).GetChunkData(id.first);
+	}
+
+	return ChunkData();
 }
 
 std::string Unimap::GetResourceName(int16 id)
@@ -53,20 +71,16 @@ std::string Unimap::GetResourceName(int16 id)
 	}
 }
 
-void Unimap::SetResource(ResourceIdentifier id, const std::vector<uint8>& data)
+void Unimap::SetResource(ResourceIdentifier id, std::vector<uint8>&& data)
 {
-	Wad wad;
-	if (HasWad(id.second))
-		wad = GetWad(id.second);
-	wad.AddChunk(id.first, data);
-	SetWad(id.second, wad);
+	SetChunk(id.second, id.first, std::move(data));
 	resources_.erase(id);
 }
 
 std::vector<Unimap::ResourceIdentifier> Unimap::GetResourceIdentifiers()
 {
 	std::vector<ResourceIdentifier> identifiers;
-	for (std::map<ResourceIdentifier, std::vector<uint8> >::const_iterator it = resources_.begin(); it != resources_.end(); ++it)
+	for (std::map<ResourceIdentifier, ChunkData>::const_iterator it = resources_.begin(); it != resources_.end(); ++it)
 	{
 		identifiers.push_back(it->first);
 	}
@@ -93,6 +107,62 @@ std::vector<Unimap::ResourceIdentifier> Unimap::GetResourceIdentifiers()
 	return identifiers;
 }
 
+// enough votes to settle on an encoding; level names are always all
+// looked at, since they're short and already loaded
+static const int kEncodingSamples = 32;
+
+static void sample_text(EncodingDetector& detector, ByteView text)
+{
+	const char* begin = reinterpret_cast<const char*>(text.data());
+	detector.Sample(begin, begin + text.size());
+}
+
+TextConverter::Encoding Unimap::text_encoding()
+{
+	if (encoding_known_)
+		return encoding_;
+
+	EncodingDetector detector;
+	std::vector<int16> wad_indexes = GetWadIndexes();
+	for (std::vector<int16>::const_iterator it = wad_indexes.begin(); it != wad_indexes.end(); ++it)
+	{
+		detector.Sample(GetLevelName(*it));
+	}
+
+	std::vector<ResourceIdentifier> ids = GetResourceIdentifiers();
+	for (std::vector<ResourceIdentifier>::const_iterator it = ids.begin(); it != ids.end() && detector.samples() < kEncodingSamples; ++it)
+	{
+		if (it->first == FOUR_CHARS_TO_INT('T','E','X','T') || it->first == FOUR_CHARS_TO_INT('t','e','x','t'))
+		{
+			sample_text(detector, GetResource(*it));
+		}
+	}
+
+	for (std::vector<int16>::const_iterator it = wad_indexes.begin(); it != wad_indexes.end() && detector.samples() < kEncodingSamples; ++it)
+	{
+		const Wad& wad = GetWad(*it);
+		if (!wad.HasChunk(TerminalChunk::kTag))
+			continue;
+
+		// a level whose terminals don't parse just doesn't get a vote
+		try
+		{
+			TerminalChunk terminals(wad.GetChunk(TerminalChunk::kTag));
+			for (std::vector<TerminalText>::const_iterator text = terminals.terminal_texts_.begin(); text != terminals.terminal_texts_.end(); ++text)
+			{
+				sample_text(detector, text->text_);
+			}
+		}
+		catch (const std::exception&)
+		{
+		}
+	}
+
+	encoding_ = detector.encoding();
+	encoding_known_ = true;
+	return encoding_;
+}
+
 bool Unimap::LoadMacBinary()
 {
 	// detect if it's MacBinary
@@ -124,13 +194,15 @@ bool Unimap::LoadMacBinary()
 //	resource_length_ = resource_length;
 
 	stream_.seekg(resource_offset);
-	LoadResourceFork(stream_, resource_length);
+	LoadResourceFork(stream_, resource_length, mapping_);
 	return true;
 
 }
 
 bool Unimap::Load(const std::string& path)
 {
+	encoding_known_ = false;
+
 	// detect if the file is MacBinary
 	if (!LoadMacBinary())
 	{
@@ -143,7 +215,7 @@ bool Unimap::Load(const std::string& path)
 			rsrc_fork.seekg(0, std::ios::end);
 			std::streamsize length = rsrc_fork.tellg();
 			rsrc_fork.seekg(0);
-			if (length) LoadResourceFork(rsrc_fork, length);
+			if (length) LoadResourceFork(rsrc_fork, length, std::shared_ptr<const MappedFile>());
 		}
 		catch (const std::ios_base::failure& e)
 		{
@@ -253,7 +325,7 @@ bool ResourceMap::Load(AIStreamBE& stream)
 	
 }
 
-void Unimap::LoadResourceFork(std::istream& stream, std::streamsize size)
+void Unimap::LoadResourceFork(std::istream& stream, std::streamsize size, const std::shared_ptr<const MappedFile>& file)
 {
 	std::streampos start = stream.tellg();
 
@@ -295,8 +367,16 @@ void Unimap::LoadResourceFork(std::istream& stream, std::streamsize size)
 		uint32 length;
 		length_stream >> length;
 		
-		resources_[it->first].resize(length);
-		stream.read(reinterpret_cast<char*>(&resources_[it->first][0]), length);
+		if (file)
+		{
+			resources_[it->first] = ChunkData(file, file->view(stream.tellg(), length));
+		}
+		else
+		{
+			std::vector<uint8> data(length);
+			stream.read(reinterpret_cast<char*>(&data[0]), length);
+			resources_[it->first] = ChunkData(std::move(data));
+		}
 
 		if (resource_map.name_offsets.count(it->first))
 		{
@@ -321,8 +401,3 @@ void Unimap::LoadResourceFork(std::istream& stream, std::streamsize size)
 	}
 
 }
-
-void Unimap::Seek(std::streampos pos)
-{
-	stream_.seekg(data_fork_ + pos);
-}
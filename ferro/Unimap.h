@@ -24,6 +24,7 @@
 #define UNIMAP_H
 
 #include "ferro/Wadfile.h"
+#include "ferro/macroman.h"
 #include <iostream>
 
 namespace marathon
@@ -31,29 +32,42 @@ namespace marathon
 	class Unimap : public Wadfile
 	{
 	public:
+		Unimap() : data_fork_(0), data_length_(0), encoding_known_(false), encoding_(TextConverter::kMacRoman) { }
+
 		typedef std::pair<uint32, int16> ResourceIdentifier
 ;
 		bool HasResource(uint32 type, int16 id) { return HasResource(ResourceIdentifier(type, id)); }
 		bool HasResource(ResourceIdentifier id);
 
-		const std::vector<uint8>& GetResource(uint32 type, int16 id) { return GetResource(ResourceIdentifier(type, id)); }
-		const std::vector<uint8>& GetResource(ResourceIdentifier id);
+		ByteView GetResource(uint32 type, int16 id) { return GetResource(ResourceIdentifier(type, id)); }
+		ByteView GetResource(ResourceIdentifier id);
+
+		// the resource without copying, still valid after the Unimap
+		// is closed or destroyed
+		ChunkData GetResourceData(ResourceIdentifier id);
 
 		std::string GetResourceName(int16 id);
 
-		void SetResource(uint32 type, int16 id, const std::vector<uint8>& data) { SetResource(ResourceIdentifier(type, id), data); }
-		void SetResource(ResourceIdentifier id, const std::vector<uint8>& data);
+		void SetResource(uint32 type, int16 id, const std::vector<uint8>& data) { SetResource(ResourceIdentifier(type, id), std::vector<uint8>(data)); }
+		void SetResource(uint32 type, int16 id, std::vector<uint8>&& data) { SetResource(ResourceIdentifier(type, id), std::move(data)); }
+		void SetResource(ResourceIdentifier id, const std::vector<uint8>& data) { SetResource(id, std::vector<uint8>(data)); }
+		void SetResource(ResourceIdentifier id, std::vector<uint8>&& data);
 
 		void SetResourceName(int16 id, const std::string& name) { SetLevelName(id, name); }
 
 		std::vector<ResourceIdentifier> GetResourceIdentifiers();
 
+		// the encoding of the scenario's level names, terminals and
+		// TEXT resources; worked out from a sample of them the first
+		// time it's asked for, and kept until the next open
+		TextConverter::Encoding text_encoding();
+
 	private:
 		bool LoadMacBinary();
 		bool Load(const std::string& path);
-		void LoadResourceFork(std::istream& stream, std::streamsize size);
+		void LoadResourceFork(std::istream& stream, std::streamsize size, const std::shared_ptr<const MappedFile>& file);
 
-		virtual void Seek(std::streampos pos);
+		std::streamoff DataForkOffset() const { return data_fork_; }
 
 		void LoadResource(ResourceIdentifier id);
 
@@ -61,8 +75,11 @@ namespace marathon
 		std::streamsize data_length_;
 
 		// loaded resources
-		std::map<ResourceIdentifier, std::vector<uint8> > resources_;
+		std::map<ResourceIdentifier, ChunkData> resources_;
 		std::map<int16, std::string> names_;
+
+		bool encoding_known_;
+		TextConverter::Encoding encoding_;
 	};
 };
 
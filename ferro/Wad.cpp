@@ -19,40 +19,89 @@
 */
 
 #include "AStream.h"
+#include "ferro/MappedFile.h"
 #include "ferro/Wad.h"
 #include "ferro/Wadfile.h"
 
 #include "ferro/MapInfoChunk.h"
 #include "ferro/TerminalChunk.h"
 
+#include <algorithm>
+
 #include <boost/assign/list_of.hpp>
 
 using namespace marathon;
 
+static int SaveRank(uint32 tag);
+
+Wad::chunk_list::const_iterator Wad::Find(uint32 tag) const
+{
+	chunk_list::const_iterator it = std::lower_bound(chunks_.begin(), chunks_.end(), tag, [](const Chunk& chunk, uint32 tag) { return chunk.tag < tag; });
+	if (it != chunks_.end() && it->tag == tag)
+		return it;
+	else
+		return chunks_.end();
+}
+
+ChunkData& Wad::Insert(uint32 tag)
+{
+	chunk_list::iterator it = std::lower_bound(chunks_.begin(), chunks_.end(), tag, [](const Chunk& chunk, uint32 tag) { return chunk.tag < tag; });
+	if (it == chunks_.end() || it->tag != tag)
+	{
+		Chunk chunk;
+		chunk.tag = tag;
+		chunk.save_rank = SaveRank(tag);
+		it = chunks_.insert(it, chunk);
+	}
+
+	return it->data;
+}
+
 bool Wad::HasChunk(uint32 tag) const
 {
-	return chunks_.count(tag);
+	return Find(tag) != chunks_.end();
+}
+
+ByteView Wad::GetChunk(uint32 tag) const
+{
+	chunk_list::const_iterator it = Find(tag);
+	if (it != chunks_.end())
+	{
+		return it->data.view();
+	}
+	else
+	{
+		return ByteView();
+	}
 }
 
-const std::vector<uint8>& Wad::GetChunk(uint32 tag) const
+ChunkData Wad::GetChunkData(uint32 tag) const
 {
-	if (chunks_.count(tag))
+	chunk_list::const_iterator it = Find(tag);
+	if (it != chunks_.end())
 	{
-		return chunks_.find(tag)->second;
+		return it->data;
 	}
 	else
 	{
-		static std::vector<uint8> empty_vector;
-		return empty_vector;
+		return ChunkData();
 	}
 }
 
+void Wad::RemoveChunk(uint32 tag)
+{
+	chunk_list::const_iterator it = Find(tag);
+	if (it != chunks_.end())
+		chunks_.erase(chunks_.begin() + (it - chunks_.begin()));
+}
+
 std::vector<uint32> Wad::GetTags() const
 {
 	std::vector<uint32> v;
-	for (chunk_map::const_iterator it = chunks_.begin(); it != chunks_.end(); ++it)
+	v.reserve(chunks_.size());
+	for (chunk_list::const_iterator it = chunks_.begin(); it != chunks_.end(); ++it)
 	{
-		v.push_back(it->first);
+		v.push_back(it->tag);
 	}
 	
 	return v;
@@ -76,22 +125,59 @@ void Wad::Load(std::istream& s, int16 entry_header_length)
 		header.Load(header_stream, entry_header_length);
 
 		// load the tag data
-		std::vector<uint8>& tag_data = chunks_[header.tag];
-		tag_data.resize(header.length);
+		std::vector<uint8> tag_data(header.length);
 		s.read(reinterpret_cast<char *>(&tag_data.front()), tag_data.size());
+		Insert(header.tag) = ChunkData(std::move(tag_data));
+		if (header.next_offset) 
+			s.seekg(start + static_cast<std::streamoff>(header.next_offset));
+
+	} while (header.next_offset);
+}
+
+void Wad::Load(std::istream& s, int16 entry_header_length, const std::shared_ptr<const ChunkReader>& reader)
+{
+	std::streampos start = s.tellg();
+
+	EntryHeader header;
+	do {
+		std::vector<uint8> header_data(entry_header_length);
+		s.read(reinterpret_cast<char*>(&header_data[0]), header_data.size());
+		AIStreamBE header_stream(&header_data[0], header_data.size());
+		header.Load(header_stream, entry_header_length);
+
+		// note where the tag data is, but don't read it yet
+		std::streamoff offset = s.tellg();
+		Insert(header.tag) = ChunkData(reader, offset, header.length);
 		if (header.next_offset) 
 			s.seekg(start + static_cast<std::streamoff>(header.next_offset));
 
 	} while (header.next_offset);
 }
 
+void Wad::Load(const std::shared_ptr<const MappedFile>& file, std::size_t start, int16 entry_header_length)
+{
+	std::size_t offset = start;
+
+	EntryHeader header;
+	do {
+		ByteView header_data = file->view(offset, entry_header_length);
+		AIStreamBE header_stream(header_data.data(), header_data.size());
+		header.Load(header_stream, entry_header_length);
+
+		// no copy; the chunk points into the mapping
+		Insert(header.tag) = ChunkData(file, file->view(offset + entry_header_length, header.length));
+		offset = start + header.next_offset;
+
+	} while (header.next_offset);
+}
+
 int32 Wad::GetSize() const
 {
 	int32 size = 0;
-	for (chunk_map::const_iterator it = chunks_.begin(); it != chunks_.end(); ++it)
+	for (chunk_list::const_iterator it = chunks_.begin(); it != chunks_.end(); ++it)
 	{
-		if (it->second.size())
-			size += it->second.size() + kEntryHeaderSize;
+		if (it->data.size())
+			size += it->data.size() + kEntryHeaderSize;
 	}
 
 	return size;
@@ -121,57 +207,52 @@ const std::vector<uint32> tag_save_list = boost::assign::list_of
 			     (FOUR_CHARS_TO_INT('W','P','p','x'))
 			     (FOUR_CHARS_TO_INT('S','h','P','a'));
 	
-void Wad::Save(crc_ostream& s) const
+// tags we know about go in the standard Forge order, then any others
+// in tag order
+static int SaveRank(uint32 tag)
 {
-	// build an array of tags
-	std::map<uint32, bool> used;
-	std::vector<uint32> tags;
+	std::vector<uint32>::const_iterator it = std::find(tag_save_list.begin(), tag_save_list.end(), tag);
+	return it - tag_save_list.begin();
+}
 
-	// use standard Forge order for the tags we know about
-	for (std::vector<uint32>::const_iterator it = tag_save_list.begin(); it != tag_save_list.end(); ++it)
-	{
-		if (chunks_.count(*it) && chunks_.find(*it)->second.size())
-		{
-			tags.push_back(*it);
-			used[*it] = true;
-		}
-	}
-	
-	// catch any remaining tags
-	for (chunk_map::const_iterator it = chunks_.begin(); it != chunks_.end(); ++it)
+void Wad::Save(crc_ostream& s) const
+{
+	// chunks_ is in tag order, so a stable sort keeps the unknown
+	// tags in tag order
+	std::vector<const Chunk*> chunks;
+	chunks.reserve(chunks_.size());
+	for (chunk_list::const_iterator it = chunks_.begin(); it != chunks_.end(); ++it)
 	{
-		if (it->second.size() && !used.count(it->first))
-		{
-			tags.push_back(it->first);
-			used[it->first] = true;
-		}
+		if (it->data.size())
+			chunks.push_back(&*it);
 	}
+	std::stable_sort(chunks.begin(), chunks.end(), [](const Chunk* a, const Chunk* b) { return a->save_rank < b->save_rank; });
 
 	int32 offset = 0;
 
-	for (std::vector<uint32>::const_iterator it = tags.begin(); it != tags.end(); ++it)
+	for (std::vector<const Chunk*>::const_iterator it = chunks.begin(); it != chunks.end(); ++it)
 	{
-		const std::vector<uint8>& chunk = chunks_.find(*it)->second;
+		ByteView chunk = (*it)->data.view();
 
 		EntryHeader header;
-		header.tag = *it;
+		header.tag = (*it)->tag;
 		header.length = chunk.size();
-		if (it == tags.end() - 1)
+		if (it == chunks.end() - 1)
 			header.next_offset = 0;
 		else
 			header.next_offset = offset + kEntryHeaderSize + header.length;
 		header.offset = 0;
 
-		std::vector<uint8> header_buffer(kEntryHeaderSize);
-		AOStreamBE header_stream(&header_buffer[0], header_buffer.size());
+		uint8 header_buffer[kEntryHeaderSize];
+		AOStreamBE header_stream(header_buffer, kEntryHeaderSize);
 		header.Save(header_stream);
-		s.write(reinterpret_cast<const char *>(&header_buffer[0]), header_buffer.size());
-		s.write(reinterpret_cast<const char *>(&chunk[0]), chunk.size());
+		s.write(reinterpret_cast<const char *>(header_buffer), kEntryHeaderSize);
+		s.write(reinterpret_cast<const char *>(chunk.data()), chunk.size());
 		offset += header.length + kEntryHeaderSize;
 	}
 }
 
-void Wad::EntryHeader::Load(AIStream& s, int16 entry_header_length)
+void Wad::EntryHeader::Load(AIStreamBE& s, int16 entry_header_length)
 {
 	s >> tag;
 	s >> next_offset;
@@ -184,7 +265,7 @@ void Wad::EntryHeader::Load(AIStream& s, int16 entry_header_length)
 
 }
 
-void Wad::EntryHeader::Save(AOStream& s)
+void Wad::EntryHeader::Save(AOStreamBE& s)
 {
 	s << tag;
 	s << next_offset;
@@ -194,9 +275,9 @@ void Wad::EntryHeader::Save(AOStream& s)
 
 std::ostream& marathon::operator<<(std::ostream& s, const Wad& w)
 {
-	for (std::map<uint32, std::vector<uint8> >::const_iterator it = w.chunks_.begin(); it != w.chunks_.end(); ++it)
+	for (Wad::chunk_list::const_iterator it = w.chunks_.begin(); it != w.chunks_.end(); ++it)
 	{
-		s << std::string(reinterpret_cast<const char*>(&it->first), 4) << std::endl;
+		s << std::string(reinterpret_cast<const char*>(&it->tag), 4) << std::endl;
 	}
 }
 
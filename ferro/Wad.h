@@ -22,18 +22,20 @@
 #define WAD_H
 
 #include "ferro/cstypes.h"
+#include "ferro/ChunkData.h"
 
 #include <iostream>
-#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
-class AIStream;
-class AOStream;
+class AIStreamBE;
+class AOStreamBE;
 
 namespace marathon
 {
 	class crc_ostream;
+	class MappedFile;
 	
 	class Wad
 	{
@@ -49,11 +51,22 @@ namespace marathon
 		
 		void Load(std::istream& stream);
 		void Load(std::istream& stream, int16 entry_header_length);
+
+		// chunks borrow their data from the mapped file
+		void Load(const std::shared_ptr<const MappedFile>& file, std::size_t offset, int16 entry_header_length);
+
+		// only the entry headers are read now; each chunk is read
+		// through reader the first time it's asked for
+		void Load(std::istream& stream, int16 entry_header_length, const std::shared_ptr<const ChunkReader>& reader);
 		
-		void AddChunk(uint32 tag, const std::vector<uint8>& data) { chunks_[tag] = data; }
+		void AddChunk(uint32 tag, const std::vector<uint8>& data) { Insert(tag) = ChunkData(data); }
+		void AddChunk(uint32 tag, std::vector<uint8>&& data) { Insert(tag) = ChunkData(std::move(data)); }
+		void AddChunk(uint32 tag, ByteView data) { Insert(tag) = ChunkData(data); }
 		bool HasChunk(uint32 tag) const;
-		const std::vector<uint8>& GetChunk(uint32 tag) const;
-		void RemoveChunk(uint32 tag) { chunks_.erase(tag); }
+		ByteView GetChunk(uint32 tag) const;
+		// a handle that shares the chunk's bytes (and file) with the wad
+		ChunkData GetChunkData(uint32 tag) const;
+		void RemoveChunk(uint32 tag);
 
 		std::vector<uint32> GetTags() const;
 		
@@ -62,8 +75,19 @@ namespace marathon
 		void Save(crc_ostream& s) const;
 		
 	private:
-		typedef std::map<uint32, std::vector<uint8> > chunk_map;
-		chunk_map chunks_;
+		// a level has a couple dozen chunks at most, so they're kept
+		// in a vector sorted by tag
+		struct Chunk
+		{
+			uint32 tag;
+			int save_rank; // position in the Forge save order
+			ChunkData data;
+		};
+		typedef std::vector<Chunk> chunk_list;
+		chunk_list chunks_;
+
+		chunk_list::const_iterator Find(uint32 tag) const;
+		ChunkData& Insert(uint32 tag);
 		
 		struct EntryHeader
 		{
@@ -72,8 +96,8 @@ namespace marathon
 			int32 length;
 			int32 offset;
 			
-			void Load(AIStream& stream, int16 entry_header_length);
-			void Save(AOStream& stream);
+			void Load(AIStreamBE& stream, int16 entry_header_length);
+			void Save(AOStreamBE& stream);
 		};
 	};
 
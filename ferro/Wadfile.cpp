@@ -19,25 +19,107 @@
 */
 
 #include "ferro/AStream.h"
+#include "ferro/Crc32.h"
+#include "ferro/MappedFile.h"
 #include "ferro/Wadfile.h"
 
+#include <algorithm>
+#include <cstdio>
 #include <fstream>
+#include <mutex>
+#include <sstream>
 #include <string.h>
 
 using namespace marathon;
 
+namespace
+{
+	// reads chunks through its own handle on the file, so wads copied
+	// out of a Wadfile can still read them after it moves on or closes
+	class FileChunkReader : public ChunkReader
+	{
+	public:
+		FileChunkReader(const std::string& path)
+		{
+			stream_.exceptions(std::ifstream::eofbit | std::ifstream::failbit | std::ifstream::badbit);
+			stream_.open(path.c_str(), std::ios::in | std::ios::binary);
+		}
+
+		std::vector<uint8> Read(std::size_t offset, std::size_t length) const
+		{
+			std::vector<uint8> data(length);
+			std::lock_guard<std::mutex> lock(mutex_);
+			// a short read of an earlier chunk leaves the stream
+			// failed; only that chunk should fail
+			stream_.clear();
+			stream_.seekg(offset);
+			if (length)
+				stream_.read(reinterpret_cast<char*>(&data[0]), length);
+			return data;
+		}
+
+	private:
+		mutable std::ifstream stream_;
+		mutable std::mutex mutex_;
+	};
+
+	// closes a partly written file and deletes it
+	void DiscardFile(std::ofstream& stream, const std::string& path)
+	{
+		stream.exceptions(std::ios_base::goodbit);
+		stream.close();
+		std::remove(path.c_str());
+	}
+}
+
 bool Wadfile::Open(const std::string& filename)
+{
+	mapping_.reset();
+	return OpenStream(filename);
+}
+
+bool Wadfile::OpenMapped(const std::string& filename)
+{
+	// the header and directory are small, so they are still read
+	// through the stream; only wad data comes from the mapping
+	std::shared_ptr<MappedFile> file(new MappedFile);
+	if (!file->Open(filename))
+		return false;
+
+	mapping_ = file;
+	if (!OpenStream(filename))
+	{
+		mapping_.reset();
+		return false;
+	}
+
+	return true;
+}
+
+bool Wadfile::OpenStream(const std::string& filename)
 {
 	if (stream_.is_open()) stream_.close();
 
 	try {
 		stream_.open(filename.c_str(), std::ios::in | std::ios::binary);
 	} 
-	catch (std::ios_base::failure e)
+	catch (const std::ios_base::failure&)
 	{
 		return false;
 	}
 
+	reader_.reset();
+	if (!mapping_)
+	{
+		try {
+			reader_ = std::make_shared<FileChunkReader>(filename);
+		}
+		catch (const std::ios_base::failure&)
+		{
+			return false;
+		}
+	}
+
 	return Load(filename);
 }
 
@@ -66,7 +148,7 @@ bool Wadfile::Load(const std::string&)
 			}
 		}
 	} 
-	catch (std::ios_base::failure e)
+	catch (const std::ios_base::failure&)
 	{
 		return false;
 	}
@@ -77,96 +159,309 @@ bool Wadfile::Load(const std::string&)
 void Wadfile::Close()
 {
 	directory_.clear();
+	builders_.clear();
+	pending_level_names_.clear();
 	if (stream_.is_open()) stream_.close();
+	mapping_.reset();
+	reader_.reset();
+}
+
+Wadfile::Header Wadfile::NewHeader() const
+{
+	Header header;
+	header.entry_header_size = Wad::kEntryHeaderSize;
+	header.data_version = header_.data_version;
+	strncpy(header.file_name, header_.file_name, Header::kFilenameLength);
+	header.file_name[Header::kFilenameLength - 1] = '\0';
+
+	header.wad_count = 0;
+	header.directory_offset = Header::kSize;
+
+	return header;
+}
+
+const Wad& Wadfile::PeekWad(int16 index, Wad& scratch)
+{
+	std::map<int16, Wad>::const_iterator loaded = wads_.find(index);
+	if (loaded != wads_.end())
+		return loaded->second;
+
+	LoadWad(index, scratch);
+	return scratch;
+}
+
+void Wadfile::AddEntry(Header& header, std::map<int16, DirectoryEntry>& entries, int16 index, const Wad& wad)
+{
+	DirectoryEntry& entry = entries[index];
+	entry.index = index;
+	entry.offset = header.directory_offset;
+	entry.size = wad.GetSize();
+	if (entry.size)
+	{
+		++header.wad_count;
+		header.directory_offset += entry.size;
+	}
+
+	if (!directory_data_.count(index))
+		UpdateDirectory(index, wad);
+}
+
+bool Wadfile::FinishHeader(Header& header)
+{
+	if (header.wad_count == 0) 
+		return false;
+	else if (header.wad_count == 1)
+	{
+		header.version = Header::WADFILE_SUPPORTS_OVERLAYS;
+		header.application_specific_directory_data_size = 0;
+	}
+
+	return true;
+}
+
+void Wadfile::SaveDirectory(crc_ostream& stream, const Header& header, const std::map<int16, DirectoryEntry>& entries)
+{
+	for (std::map<int16, DirectoryEntry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+	{
+		it->second.Save(stream);
+		if (header.application_specific_directory_data_size > 0)
+		{
+			directory_data_[it->first].Save(stream);
+		}
+	}
 }
 
 bool Wadfile::Save(const std::string& path)
 {
+	if (directory_.empty())
+		return false;
+
+	// written beside path and renamed over it once complete, so a
+	// failed save leaves the old file alone, and saving over the file
+	// this Wadfile is still reading from doesn't pull it out from under
+	// the wads
+	const std::string temp_path = path + ".tmp";
 	std::ofstream stream;
 	stream.exceptions(std::ofstream::eofbit | std::ofstream::failbit | std::ofstream::badbit);
 	
 	try 
 	{
-		stream.open(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
-		crc_ostream crc_stream(stream);
+		stream.open(temp_path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
 
-		std::streampos start = crc_stream.tellp();
+		std::streampos start = stream.tellp();
 
-		// write the header
-		Header newHeader;
-		newHeader.entry_header_size = Wad::kEntryHeaderSize;
-		newHeader.data_version = header_.data_version;
-		strncpy(newHeader.file_name, header_.file_name, Header::kFilenameLength);
-		newHeader.file_name[Header::kFilenameLength - 1] = '\0';
-	
-		newHeader.wad_count = 0;
-		newHeader.directory_offset = Header::kSize;
+		Header newHeader = NewHeader();
+
+		// the header depends on the size of every wad, so leave room
+		// for it and fill it in at the end
+		std::vector<char> placeholder(Header::kSize);
+		stream.write(&placeholder[0], placeholder.size());
+
+		crc_ostream crc_stream(stream);
 
-		for (std::map<int16, DirectoryEntry>::iterator it = directory_.begin(); it != directory_.end(); ++it)
+		// write wads; directory_ still describes the file we opened,
+		// so the new offsets go in a copy
+		std::map<int16, DirectoryEntry> entries;
+		for (std::map<int16, DirectoryEntry>::const_iterator it = directory_.begin(); it != directory_.end(); ++it)
 		{
-			if (it->second.size)
-			{
-				++newHeader.wad_count;
-				it->second.offset = newHeader.directory_offset;
-				newHeader.directory_offset += it->second.size;
-			}
+			Wad scratch;
+			const Wad& wad = PeekWad(it->first, scratch);
+			AddEntry(newHeader, entries, it->first, wad);
+			wad.Save(crc_stream);
 		}
 
-		if (newHeader.wad_count == 0) 
-			return false;
-		else if (newHeader.wad_count == 1)
+		if (!FinishHeader(newHeader))
 		{
-			newHeader.version = Header::WADFILE_SUPPORTS_OVERLAYS;
-			newHeader.application_specific_directory_data_size = 0;
+			DiscardFile(stream, temp_path);
+			return false;
 		}
 	
+		SaveDirectory(crc_stream, newHeader, entries);
+
+		std::streampos end = stream.tellp();
+
+		// the checksum covers the header too (with a zero checksum),
+		// which comes first in the file
+		crc_ostream header_crc;
+		newHeader.Save(header_crc);
+		newHeader.checksum = crc32_combine(header_crc.checksum(), crc_stream.checksum(), static_cast<std::size_t>(end - start) - Header::kSize);
+
+		crc_stream.seekp(start);
 		newHeader.Save(crc_stream);
-	
-		// write wads
-		for (std::map<int16, DirectoryEntry>::const_iterator it = directory_.begin(); it != directory_.end(); ++it)
+		crc_stream.seekp(end);
+		stream.close();
+	}
+	catch (const std::ios_base::failure&)
+	{
+		DiscardFile(stream, temp_path);
+		return false;
+	}
+	catch (...)
+	{
+		// a wad builder failed
+		DiscardFile(stream, temp_path);
+		throw;
+	}
+
+	if (std::rename(temp_path.c_str(), path.c_str()) != 0)
+	{
+		// Windows won't rename over an existing file
+		std::remove(path.c_str());
+		if (std::rename(temp_path.c_str(), path.c_str()) != 0)
 		{
-			const Wad& wad = GetWad(it->first);
-			wad.Save(crc_stream);
+			std::remove(temp_path.c_str());
+			return false;
 		}
+	}
+
+	return true;
+}
+
+bool Wadfile::Save(std::ostream& stream)
+{
+	if (directory_.empty())
+		return false;
+
+	std::ios_base::iostate exceptions = stream.exceptions();
+	bool saved = false;
 
-		// write directory
+	try
+	{
+		stream.exceptions(std::ios_base::eofbit | std::ios_base::failbit | std::ios_base::badbit);
+
+		// first pass: lay out the file and checksum everything after
+		// the header, without writing anything; only each wad's size
+		// and checksum are kept, so wads are dropped as soon as they
+		// are measured
+		Header newHeader = NewHeader();
+		std::map<int16, DirectoryEntry> entries;
+		uint32 body_crc = 0;
 		for (std::map<int16, DirectoryEntry>::const_iterator it = directory_.begin(); it != directory_.end(); ++it)
 		{
-			it->second.Save(crc_stream);
-			if (newHeader.application_specific_directory_data_size > 0)
-			{
-				if (!directory_data_.count(it->first))
-					UpdateDirectory(it->first);
+			Wad scratch;
+			const Wad& wad = PeekWad(it->first, scratch);
+			AddEntry(newHeader, entries, it->first, wad);
+			crc_ostream wad_crc;
+			wad.Save(wad_crc);
+			body_crc = crc32_combine(body_crc, wad_crc.checksum(), entries[it->first].size);
+		}
+
+		if (FinishHeader(newHeader))
+		{
+			std::ostringstream directory_data;
+			crc_ostream directory_stream(directory_data);
+			SaveDirectory(directory_stream, newHeader, entries);
+			const std::string directory = directory_data.str();
+			body_crc = crc32_combine(body_crc, directory_stream.checksum(), directory.size());
+
+			crc_ostream header_crc;
+			newHeader.Save(header_crc);
+			newHeader.checksum = crc32_combine(header_crc.checksum(), body_crc, newHeader.directory_offset - Header::kSize + directory.size());
+
+			// second pass: load or build each wad again and write it
+			crc_ostream crc_stream(stream);
+			newHeader.Save(crc_stream);
 
-				directory_data_[it->first].Save(crc_stream);
+			saved = true;
+			for (std::map<int16, DirectoryEntry>::const_iterator it = entries.begin(); saved && it != entries.end(); ++it)
+			{
+				Wad scratch;
+				const Wad& wad = PeekWad(it->first, scratch);
+
+				// builders have to give the same wad both times
+				if (wad.GetSize() == it->second.size)
+					wad.Save(crc_stream);
+				else
+					saved = false;
 			}
+
+			if (saved)
+				crc_stream.write(directory.data(), directory.size());
 		}
+	}
+	catch (const std::ios_base::failure&)
+	{
+		saved = false;
+	}
 
-		std::streampos end = crc_stream.tellp();
+	stream.exceptions(exceptions);
+	return saved;
+}
 
-		// write in the CRC
-		newHeader.checksum = crc_stream.checksum();
-		crc_stream.seekp(start);
+bool Wadfile::VerifyChecksum()
+{
+	// the checksum covers everything up to the end of the directory,
+	// with the checksum field itself zeroed
+	std::size_t length = header_.directory_offset + header_.wad_count * (header_.directory_entry_base_size + header_.application_specific_directory_data_size);
+	if (length < Header::kSize)
+		return false;
+
+	std::vector<uint8> header(Header::kSize);
+	uint32 crc;
+	try 
+	{
+		if (mapping_)
 		{
-			newHeader.Save(crc_stream);
+			if (DataForkOffset() + length > mapping_->size())
+				return false;
+
+			const uint8* data = mapping_->data() + DataForkOffset();
+			std::copy(data, data + Header::kSize, header.begin());
+			crc = crc32_parallel(data + Header::kSize, length - Header::kSize);
+		}
+		else
+		{
+			Seek(0);
+			stream_.read(reinterpret_cast<char*>(&header[0]), header.size());
+
+			Crc32 body;
+			std::vector<char> buffer(1 << 20);
+			for (std::size_t left = length - Header::kSize; left > 0; )
+			{
+				std::size_t n = std::min(left, buffer.size());
+				stream_.read(&buffer[0], n);
+				body.process_bytes(&buffer[0], n);
+				left -= n;
+			}
+			crc = body.checksum();
 		}
-		crc_stream.seekp(end);
 	}
-	catch (std::ios_base::failure e)
+	catch (const std::ios_base::failure&)
 	{
+		stream_.clear();
 		return false;
 	}
 
-	return true;
+	std::fill_n(header.begin() + Header::kChecksumOffset, 4, 0);
+	return crc32_combine(crc32(&header[0], header.size()), crc, length - Header::kSize) == header_.checksum;
+}
+
+void Wadfile::LoadWad(int16 index, Wad& wad)
+{
+	std::map<int16, std::function<Wad ()> >::const_iterator builder = builders_.find(index);
+	if (builder != builders_.end())
+	{
+		wad = builder->second();
+	}
+	else if (mapping_)
+	{
+		wad.Load(mapping_, DataForkOffset() + directory_[index].offset, header_.entry_header_size);
+	}
+	else
+	{
+		Seek(directory_[index].offset);
+		wad.Load(stream_, header_.entry_header_size, reader_);
+	}
 }
 
 const Wad& Wadfile::GetWad(int16 index)
 {
 	if (!wads_.count(index))
 	{
-		std::vector<char> buffer(directory_[index].size);
-		Seek(directory_[index].offset);
-		wads_[index].Load(stream_, header_.entry_header_size);
+		Wad wad;
+		LoadWad(index, wad);
+		builders_.erase(index);
+		wads_[index] = std::move(wad);
 	}
 	return wads_[index];
 }
@@ -174,11 +469,38 @@ const Wad& Wadfile::GetWad(int16 index)
 void Wadfile::SetWad(int16 index, const Wad& wad)
 {
 	wads_[index] = wad;
+	builders_.erase(index);
+	pending_level_names_.erase(index);
 	directory_[index].index = index;
 	directory_[index].size = wad.GetSize();
 	UpdateDirectory(index);
 }
 
+void Wadfile::SetWad(int16 index, const std::function<Wad ()>& builder)
+{
+	wads_.erase(index);
+	builders_[index] = builder;
+	pending_level_names_.erase(index);
+	directory_[index].index = index;
+	directory_[index].size = 0;
+	directory_data_.erase(index);
+}
+
+void Wadfile::SetChunk(int16 index, uint32 tag, std::vector<uint8>&& data)
+{
+	if (HasWad(index))
+		GetWad(index);
+
+	Wad& wad = wads_[index];
+	wad.AddChunk(tag, std::move(data));
+	directory_[index].index = index;
+	directory_[index].size = wad.GetSize();
+
+	// only the map info chunk changes the directory data
+	if (tag == MapInfo::kTag || !directory_data_.count(index))
+		UpdateDirectory(index, wad);
+}
+
 uint32 Wadfile::GetEntryPointFlags(int16 index)
 {
 	if (directory_.count(index))
@@ -212,7 +534,16 @@ std::string Wadfile::GetLevelName(int16 index)
 void Wadfile::SetLevelName(int16 index, const std::string& name)
 {
 	if (!directory_data_.count(index))
+	{
+		if (builders_.count(index))
+		{
+			// don't build the wad just to name it
+			pending_level_names_[index] = name;
+			return;
+		}
+
 		UpdateDirectory(index);
+	}
 
 	strncpy(directory_data_[index].level_name, name.c_str(), MapInfo::kLevelNameLength);
 	directory_data_[index].level_name[MapInfo::kLevelNameLength - 1] = '\0';
@@ -298,9 +629,21 @@ void Wadfile::Header::Save(crc_ostream& stream)
 
 void Wadfile::UpdateDirectory(int16 index)
 {
-	bool wasLoaded = wads_.count(index);
+	std::map<int16, Wad>::const_iterator it = wads_.find(index);
+	if (it != wads_.end())
+	{
+		UpdateDirectory(index, it->second);
+	}
+	else
+	{
+		Wad wad;
+		LoadWad(index, wad);
+		UpdateDirectory(index, wad);
+	}
+}
 
-	const Wad& wad = GetWad(index);
+void Wadfile::UpdateDirectory(int16 index, const Wad& wad)
+{
 	DirectoryData entry;
 	if (wad.HasChunk(MapInfo::kTag))
 	{
@@ -312,9 +655,16 @@ void Wadfile::UpdateDirectory(int16 index)
 		strncpy(entry.level_name, info.level_name().c_str(), MapInfo::kLevelNameLength);
 		entry.level_name[MapInfo::kLevelNameLength - 1] = '\0';
 	}
-	directory_data_[index] = entry;
 
-	if (!wasLoaded) wads_.erase(index);
+	std::map<int16, std::string>::iterator name = pending_level_names_.find(index);
+	if (name != pending_level_names_.end())
+	{
+		strncpy(entry.level_name, name->second.c_str(), MapInfo::kLevelNameLength);
+		entry.level_name[MapInfo::kLevelNameLength - 1] = '\0';
+		pending_level_names_.erase(name);
+	}
+
+	directory_data_[index] = entry;
 }
 
 void Wadfile::DirectoryEntry::Load(std::istream& stream, int16 directory_entry_base_size, int16 new_index)
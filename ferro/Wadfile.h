@@ -21,21 +21,22 @@
 #ifndef WADFILE_H
 #define WADFILE_H
 
+#include "ferro/Crc32.h"
 #include "ferro/MapInfoChunk.h"
 #include "ferro/Wad.h"
 
 #include <iostream>
 #include <fstream>
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
 #include <vector>
 
-#include <boost/crc.hpp>
-
 namespace marathon
 {
 	class crc_ostream;
+	class MappedFile;
 
         class Wadfile 
 	{
@@ -44,15 +45,39 @@ namespace marathon
 		Wadfile() { stream_.exceptions(std::ifstream::eofbit | std::ifstream::failbit | std::ifstream::badbit);  }
 
 		virtual bool Open(const std::string& path);
+
+		// maps the file into memory; wads read from it borrow their
+		// chunk data from the mapping instead of copying it
+		virtual bool OpenMapped(const std::string& path);
 		virtual void Close();
 
-		// will load the whole wadfile into memory!
+		// writes one wad at a time; wads that aren't already in
+		// memory are loaded (or built), written and dropped again.
+		// The file is written as path.tmp and renamed to path when
+		// it is complete, so path can be the file this is reading
 		virtual bool Save(const std::string& path);
 
+		// writes strictly in order, so stream can be a pipe; this
+		// takes two passes over the wads, so builders are called
+		// twice, but only one wad is held at a time
+		bool Save(std::ostream& stream);
+
+		// checks the file's contents against the checksum in its header;
+		// mapped files are checksummed on all cores
+		bool VerifyChecksum();
+
 		bool HasWad(int16 index) { return directory_.count(index); }
 		const Wad& GetWad(int16 index);
 		void SetWad(int16 index, const Wad& wad);
 
+		// the wad is built by calling builder when it is needed,
+		// which is normally not until Save writes it out
+		void SetWad(int16 index, const std::function<Wad ()>& builder);
+
+		// adds or replaces one chunk in place, without copying the
+		// rest of the wad; creates the wad if there isn't one
+		void SetChunk(int16 index, uint32 tag, std::vector<uint8>&& data);
+
 		std::vector<int16> GetWadIndexes();
 		std::vector<int16> GetEntryPointIndexes(uint32 entry_point_flags = ~0);
 
@@ -72,17 +97,25 @@ namespace marathon
 		uint32 parent_checksum() { return header_.parent_checksum; }
 
 	protected:
+		bool OpenStream(const std::string& path);
 		virtual bool Load(const std::string& path);
 		std::ifstream stream_;
-		virtual void Seek(std::streampos pos) { stream_.seekg(pos); }
+		std::shared_ptr<const MappedFile> mapping_;
+		std::shared_ptr<const ChunkReader> reader_;
+		virtual std::streamoff DataForkOffset() const { return 0; }
+		void Seek(std::streampos pos) { stream_.seekg(DataForkOffset() + pos); }
 
 	private:
 		std::map<int16, Wad> wads_;
+		std::map<int16, std::function<Wad ()> > builders_;
+
+		// reads the wad from the file, or builds it, without keeping it
+		void LoadWad(int16 index, Wad& wad);
 
 		struct Header
 		{
 			static const int kFilenameLength = 64;
-			enum { kSize = 128 };
+			enum { kSize = 128, kChecksumOffset = 68 };
 			enum { 
 				PRE_ENTRY_POINT_WADFILE_VERSION = 0,
 				WADFILE_HAS_DIRECTORY_ENTRY = 1,
@@ -117,6 +150,7 @@ namespace marathon
 		} header_;
 
 		void UpdateDirectory(int16 index);
+		void UpdateDirectory(int16 index, const Wad& wad);
 
 		struct DirectoryEntry
 		{
@@ -150,24 +184,37 @@ namespace marathon
 			void Save(crc_ostream&) const;
 		};
 		std::map<int16, DirectoryData> directory_data_;
+
+		// pieces of Save
+		Header NewHeader() const;
+		const Wad& PeekWad(int16 index, Wad& scratch);
+		void AddEntry(Header& header, std::map<int16, DirectoryEntry>& entries, int16 index, const Wad& wad);
+		bool FinishHeader(Header& header);
+		void SaveDirectory(crc_ostream& stream, const Header& header, const std::map<int16, DirectoryEntry>& entries);
+
+		// names given to wads that haven't been built yet
+		std::map<int16, std::string> pending_level_names_;
 	};
 
 	class crc_ostream
 	{
 	public:
-		crc_ostream(std::ostream& stream) : stream_(stream) { }
+		crc_ostream(std::ostream& stream) : stream_(&stream) { }
+
+		// only computes the checksum; nothing is written
+		crc_ostream() : stream_(0) { }
 
-		std::streampos tellp() const { return stream_.tellp(); }
-		crc_ostream& seekp(std::streampos pos) { stream_.seekp(pos); return *this; }
-		crc_ostream& write(const char *s, std::streamsize n) { stream_.write(s, n); crc_.process_bytes(s, n); return *this; }
-		crc_ostream& write(uint8* s, std::streamsize n) { stream_.write(reinterpret_cast<char*>(s), n); crc_.process_bytes(s, n); return *this; }
+		std::streampos tellp() const { return stream_ ? stream_->tellp() : std::streampos(-1); }
+		crc_ostream& seekp(std::streampos pos) { if (stream_) stream_->seekp(pos); return *this; }
+		crc_ostream& write(const char *s, std::streamsize n) { if (stream_) stream_->write(s, n); crc_.process_bytes(s, n); return *this; }
+		crc_ostream& write(uint8* s, std::streamsize n) { return write(reinterpret_cast<char*>(s), n); }
 
-		std::ostream& stream() { return stream_; }
+		std::ostream& stream() { return *stream_; }
 		uint32 checksum() const { return crc_.checksum(); }
 
 	private:
-		std::ostream& stream_;
-		boost::crc_32_type crc_;
+		std::ostream* stream_;
+		Crc32 crc_;
 	};
 
 std::ostream& operator<<(std::ostream& s, const Wadfile& w);
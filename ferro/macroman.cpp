@@ -26,188 +26,308 @@
 #include "ferro/cstypes.h"
 #include <boost/locale/encoding.hpp>
 namespace conv = boost::locale::conv;
-#include <map>
 
-class MacRomanUnicodeConverter
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+using namespace marathon;
+
+namespace
 {
-public:
-	MacRomanUnicodeConverter();
-	inline uint16 ToUnicode(char c) {
-		return mac_roman_to_unicode_table[(unsigned char) c];
+	// from ftp://ftp.unicode.org/Public/MAPPINGS/VENDORS/APPLE/ROMAN.TXT
+	const uint16 mac_roman_to_unicode_table[256] = {
+		0x0000, 0x0001, 0x0002, 0x0003, 0x0004, 0x0005, 0x0006, 0x0007, 
+		0x0008, 0x0009, 0x000A, 0x000B, 0x000C, 0x000D, 0x000E, 0x000F, 
+		0x0010, 0x0011, 0x0012, 0x0013, 0x0014, 0x0015, 0x0016, 0x0017, 
+		0x0018, 0x0019, 0x001A, 0x001B, 0x001C, 0x001D, 0x001E, 0x001F, 
+		0x0020, 0x0021, 0x0022, 0x0023, 0x0024, 0x0025, 0x0026, 0x0027, 
+		0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F, 
+		0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037, 
+		0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F, 
+		0x0040, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047, 
+		0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F, 
+		0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057, 
+		0x0058, 0x0059, 0x005A, 0x005B, 0x005C, 0x005D, 0x005E, 0x005F, 
+		0x0060, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067, 
+		0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F, 
+		0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077, 
+		0x0078, 0x0079, 0x007A, 0x007B, 0x007C, 0x007D, 0x007E, 0x007F, 
+		0x00C4, 0x00C5, 0x00C7, 0x00C9, 0x00D1, 0x00D6, 0x00DC, 0x00E1, 
+		0x00E0, 0x00E2, 0x00E4, 0x00E3, 0x00E5, 0x00E7, 0x00E9, 0x00E8, 
+		0x00EA, 0x00EB, 0x00ED, 0x00EC, 0x00EE, 0x00EF, 0x00F1, 0x00F3, 
+		0x00F2, 0x00F4, 0x00F6, 0x00F5, 0x00FA, 0x00F9, 0x00FB, 0x00FC, 
+		0x2020, 0x00B0, 0x00A2, 0x00A3, 0x00A7, 0x2022, 0x00B6, 0x00DF, 
+		0x00AE, 0x00A9, 0x2122, 0x00B4, 0x00A8, 0x2260, 0x00C6, 0x00D8, 
+		0x221E, 0x00B1, 0x2264, 0x2265, 0x00A5, 0x00B5, 0x2202, 0x2211, 
+		0x220F, 0x03C0, 0x222B, 0x00AA, 0x00BA, 0x03A9, 0x00E6, 0x00F8, 
+		0x00BF, 0x00A1, 0x00AC, 0x221A, 0x0192, 0x2248, 0x2206, 0x00AB, 
+		0x00BB, 0x2026, 0x00A0, 0x00C0, 0x00C3, 0x00D5, 0x0152, 0x0153, 
+		0x2013, 0x2014, 0x201C, 0x201D, 0x2018, 0x2019, 0x00F7, 0x25CA, 
+		0x00FF, 0x0178, 0x2044, 0x20AC, 0x2039, 0x203A, 0xFB01, 0xFB02, 
+		0x2021, 0x00B7, 0x201A, 0x201E, 0x2030, 0x00C2, 0x00CA, 0x00C1, 
+		0x00CB, 0x00C8, 0x00CD, 0x00CE, 0x00CF, 0x00CC, 0x00D3, 0x00D4, 
+		0xF8FF, 0x00D2, 0x00DA, 0x00DB, 0x00D9, 0x0131, 0x02C6, 0x02DC, 
+		0x00AF, 0x02D8, 0x02D9, 0x02DA, 0x00B8, 0x02DD, 0x02DB, 0x02C7 
+	};
+
+	// the upper half of MacRoman, already in UTF-8
+	struct UTF8Char
+	{
+		uint8 length;
+		char bytes[3];
+	};
+
+	// Unicode to MacRoman, a 256 character page at a time; only the
+	// pages that have MacRoman characters are stored
+	struct Tables
+	{
+		UTF8Char to_utf8[128];
+		uint8 page_index[256]; // 0 is no characters
+		std::vector<std::vector<uint8> > pages;
+
+		Tables()
+		{
+			memset(page_index, 0, sizeof(page_index));
+			for (int c = 0x80; c < 0x100; ++c)
+			{
+				uint16 u = mac_roman_to_unicode_table[c];
+				UTF8Char& utf8 = to_utf8[c - 0x80];
+				if (u < 0x800)
+				{
+					utf8.length = 2;
+					utf8.bytes[0] = 0xc0 | (u >> 6);
+					utf8.bytes[1] = 0x80 | (u & 0x3f);
+				}
+				else
+				{
+					utf8.length = 3;
+					utf8.bytes[0] = 0xe0 | (u >> 12);
+					utf8.bytes[1] = 0x80 | ((u >> 6) & 0x3f);
+					utf8.bytes[2] = 0x80 | (u & 0x3f);
+				}
+
+				if (!page_index[u >> 8])
+				{
+					pages.push_back(std::vector<uint8>(256));
+					page_index[u >> 8] = pages.size();
+				}
+				pages[page_index[u >> 8] - 1][u & 0xff] = c;
+			}
+		}
+
+		// 0 if there is no MacRoman character for c
+		uint8 to_mac_roman(uint32 c) const
+		{
+			if (c > 0xffff || !page_index[c >> 8])
+				return 0;
+			return pages[page_index[c >> 8] - 1][c & 0xff];
+		}
+	};
+
+	const Tables tables;
+
+	// the end of the run of ASCII at the start of [p, end), checking 16
+	// bytes at a time
+	const char* skip_ascii(const char* p, const char* end)
+	{
+		while (end - p >= 16)
+		{
+			uint64_t a, b;
+			memcpy(&a, p, 8);
+			memcpy(&b, p + 8, 8);
+			if ((a | b) & 0x8080808080808080ULL)
+				break;
+			p += 16;
+		}
+
+		while (p != end && !(*p & 0x80))
+			++p;
+
+		return p;
 	}
 
-	inline char ToMacRoman(uint16 c) {
-		if (c <= 0x7f) return c;
-		std::map<uint16, char>::iterator it = unicode_to_mac_roman.find(c);
-		if (it != unicode_to_mac_roman.end())
-			return it->second;
-		else
-			return '?';
+	// U+FFFD if p isn't at a well formed sequence
+	uint32 next_utf8(const char*& p, const char* end)
+	{
+		uint8 c = *p++;
+		if (c < 0x80)
+			return c;
+		if (c < 0xc0)
+			return 0xfffd;
+
+		int extra = (c >= 0xf0) ? 3 : (c >= 0xe0) ? 2 : 1;
+		uint32 code = c & (0x3f >> extra);
+		for (; extra > 0 && p != end && (*p & 0xc0) == 0x80; --extra)
+			code = (code << 6) | (*p++ & 0x3f);
+
+		return extra ? 0xfffd : code;
 	}
 
-private:
-
-	static uint16 mac_roman_to_unicode_table[256];
-	static std::map<uint16, char> unicode_to_mac_roman;
-	static bool initialized;
-};
-
-// from ftp://ftp.unicode.org/Public/MAPPINGS/VENDORS/APPLE/ROMAN.TXT
-uint16 MacRomanUnicodeConverter::mac_roman_to_unicode_table[256] = {
-	0x0000, 0x0001, 0x0002, 0x0003, 0x0004, 0x0005, 0x0006, 0x0007, 
-	0x0008, 0x0009, 0x000A, 0x000B, 0x000C, 0x000D, 0x000E, 0x000F, 
-	0x0010, 0x0011, 0x0012, 0x0013, 0x0014, 0x0015, 0x0016, 0x0017, 
-	0x0018, 0x0019, 0x001A, 0x001B, 0x001C, 0x001D, 0x001E, 0x001F, 
-	0x0020, 0x0021, 0x0022, 0x0023, 0x0024, 0x0025, 0x0026, 0x0027, 
-	0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F, 
-	0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037, 
-	0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F, 
-	0x0040, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047, 
-	0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F, 
-	0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057, 
-	0x0058, 0x0059, 0x005A, 0x005B, 0x005C, 0x005D, 0x005E, 0x005F, 
-	0x0060, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067, 
-	0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F, 
-	0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077, 
-	0x0078, 0x0079, 0x007A, 0x007B, 0x007C, 0x007D, 0x007E, 0x007F, 
-	0x00C4, 0x00C5, 0x00C7, 0x00C9, 0x00D1, 0x00D6, 0x00DC, 0x00E1, 
-	0x00E0, 0x00E2, 0x00E4, 0x00E3, 0x00E5, 0x00E7, 0x00E9, 0x00E8, 
-	0x00EA, 0x00EB, 0x00ED, 0x00EC, 0x00EE, 0x00EF, 0x00F1, 0x00F3, 
-	0x00F2, 0x00F4, 0x00F6, 0x00F5, 0x00FA, 0x00F9, 0x00FB, 0x00FC, 
-	0x2020, 0x00B0, 0x00A2, 0x00A3, 0x00A7, 0x2022, 0x00B6, 0x00DF, 
-	0x00AE, 0x00A9, 0x2122, 0x00B4, 0x00A8, 0x2260, 0x00C6, 0x00D8, 
-	0x221E, 0x00B1, 0x2264, 0x2265, 0x00A5, 0x00B5, 0x2202, 0x2211, 
-	0x220F, 0x03C0, 0x222B, 0x00AA, 0x00BA, 0x03A9, 0x00E6, 0x00F8, 
-	0x00BF, 0x00A1, 0x00AC, 0x221A, 0x0192, 0x2248, 0x2206, 0x00AB, 
-	0x00BB, 0x2026, 0x00A0, 0x00C0, 0x00C3, 0x00D5, 0x0152, 0x0153, 
-	0x2013, 0x2014, 0x201C, 0x201D, 0x2018, 0x2019, 0x00F7, 0x25CA, 
-	0x00FF, 0x0178, 0x2044, 0x20AC, 0x2039, 0x203A, 0xFB01, 0xFB02, 
-	0x2021, 0x00B7, 0x201A, 0x201E, 0x2030, 0x00C2, 0x00CA, 0x00C1, 
-	0x00CB, 0x00C8, 0x00CD, 0x00CE, 0x00CF, 0x00CC, 0x00D3, 0x00D4, 
-	0xF8FF, 0x00D2, 0x00DA, 0x00DB, 0x00D9, 0x0131, 0x02C6, 0x02DC, 
-	0x00AF, 0x02D8, 0x02D9, 0x02DA, 0x00B8, 0x02DD, 0x02DB, 0x02C7 
-};
-
-std::map<uint16, char> MacRomanUnicodeConverter::unicode_to_mac_roman;
-bool MacRomanUnicodeConverter::initialized = false;
-
-MacRomanUnicodeConverter::MacRomanUnicodeConverter()
-{
-	if (!initialized)
+	bool all_mac_roman(const char* p, const char* end)
 	{
-		for (unsigned char c = 0x80; c < 0xff; c++)
+		while ((p = skip_ascii(p, end)) != end)
 		{
-			unicode_to_mac_roman[mac_roman_to_unicode_table[c]] = (char) c;
+			if (!tables.to_mac_roman(next_utf8(p, end)))
+				return false;
 		}
-		initialized = true;
+
+		return true;
 	}
 }
 
-static MacRomanUnicodeConverter macRomanUnicodeConverter;
-
-void mac_roman_to_unicode(const char *input, uint16 *output)
+void TextConverter::ToUTF8(const char* begin, const char* end, std::string& output) const
 {
-	const char *p = input;
+	output.reserve(output.size() + (end - begin));
+	if (encoding_ == kShiftJIS)
+	{
+		if (skip_ascii(begin, end) != end)
+		{
+			output += conv::to_utf<char>(begin, end, "Shift_JIS");
+			return;
+		}
 
-	while (*p)
+		// the two places Shift_JIS's single bytes differ from ASCII
+		for (const char* p = begin; p != end; ++p)
+		{
+			if (*p == '\\')
+				output += "\xc2\xa5";
+			else if (*p == '~')
+				output += "\xe2\x80\xbe";
+			else
+				output += *p;
+		}
+		return;
+	}
+
+	while (begin != end)
 	{
-		*output++ = macRomanUnicodeConverter.ToUnicode(*p++);
+		const char* ascii_end = skip_ascii(begin, end);
+		output.append(begin, ascii_end);
+		for (begin = ascii_end; begin != end && (*begin & 0x80); ++begin)
+		{
+			const UTF8Char& c = tables.to_utf8[static_cast<uint8>(*begin) - 0x80];
+			output.append(c.bytes, c.length);
+		}
 	}
-	*output = 0x0;
 }
 
-void mac_roman_to_unicode(const char *input, uint16 *output, int max_len)
+void TextConverter::FromUTF8(const char* begin, const char* end, std::string& output) const
 {
-	const char *p = input;
+	output.reserve(output.size() + (end - begin));
+	if (encoding_ == kShiftJIS)
+	{
+		if (skip_ascii(begin, end) != end)
+			output += conv::from_utf<char>(begin, end, "Shift_JIS");
+		else
+			output.append(begin, end);
+		return;
+	}
 
-	while (*p && --max_len > 0)
+	while (begin != end)
 	{
-		*output++ = macRomanUnicodeConverter.ToUnicode(*p++);
+		const char* ascii_end = skip_ascii(begin, end);
+		output.append(begin, ascii_end);
+		begin = ascii_end;
+		if (begin != end)
+		{
+			uint8 c = tables.to_mac_roman(next_utf8(begin, end));
+			output += c ? static_cast<char>(c) : '?';
+		}
 	}
-	*output = 0x0;
 }
 
-uint16 mac_roman_to_unicode(char c)
+std::string TextConverter::ToUTF8(const std::string& input) const
 {
-	return macRomanUnicodeConverter.ToUnicode(c);
+	std::string output;
+	ToUTF8(input.data(), input.data() + input.size(), output);
+	return output;
 }
 
-char unicode_to_mac_roman(uint16 c)
+std::string TextConverter::FromUTF8(const std::string& input) const
 {
-	return macRomanUnicodeConverter.ToMacRoman(c);
+	std::string output;
+	FromUTF8(input.data(), input.data() + input.size(), output);
+	return output;
 }
 
-static void unicode_to_utf8(uint16 c, std::string& output)
+namespace
 {
-	if (c < 0x80)
-	{
-		output += c;
-	}
-	else if (c < 0x800) 
-	{
-		output += (0xc0 | (c >> 6));
-		output += (0x80 | (c & 0x3f));
-	}
-	else 
+	enum ShiftJISScan {
+		kNotShiftJIS,
+		kSingleBytes, // ASCII and half-width katakana only
+		kDoubleBytes
+	};
+
+	ShiftJISScan scan_shift_jis(const char* begin, const char* end)
 	{
-		output += (0xe0 | (c >> 12));
-		output += (0x80 | ((c >> 6) & 0x3f));
-		output += (0x80 | (c & 0x3f));
+		ShiftJISScan result = kSingleBytes;
+		for (const char* p = skip_ascii(begin, end); p != end; p = skip_ascii(p, end))
+		{
+			uint8 c = *p++;
+			if (c >= 0xa1 && c <= 0xdf)
+				continue; // half-width katakana
+
+			if ((c < 0x81 || c > 0x9f) && (c < 0xe0 || c > 0xfc))
+				return kNotShiftJIS;
+
+			if (p == end)
+				return kNotShiftJIS;
+
+			uint8 trail = *p++;
+			if (trail < 0x40 || trail == 0x7f || trail > 0xfc)
+				return kNotShiftJIS;
+
+			result = kDoubleBytes;
+		}
+
+		return result;
 	}
 }
 
-static uint16 utf8_to_unicode(const char *s, int &chars_used)
+bool marathon::is_shift_jis(const char* begin, const char* end)
 {
-	const unsigned char *input = (unsigned char *) s;
-	if ((unsigned char) input[0] < 0x80)
-	{
-		chars_used = 1;
-		return input[0];
-	}
-	else if ((unsigned char) input[0] < 0xe0)
-	{
-		chars_used = 2;
-		return ((input[0] & 0x1f) << 6) | (input[1] & 0x3f);
-	}
+	return scan_shift_jis(begin, end) != kNotShiftJIS;
+}
+
+void EncodingDetector::Sample(const char* begin, const char* end)
+{
+	if (skip_ascii(begin, end) == end)
+		return;
+
+	if (scan_shift_jis(begin, end) == kDoubleBytes)
+		++shift_jis_;
 	else
-	{
-		chars_used = 3;
-		return ((input[0] & 0xf) << 12) | ((input[1] & 0x3f) << 6) | (input[2] & 0x3f);
-	}
+		++mac_roman_;
+}
+
+void EncodingDetector::SampleUTF8(const char* begin, const char* end)
+{
+	if (skip_ascii(begin, end) == end)
+		return;
+
+	if (all_mac_roman(begin, end))
+		++mac_roman_;
+	else
+		++shift_jis_;
 }
 
 std::string mac_roman_to_utf8(const std::string& input)
 {
-	try {
-		return conv::to_utf<char>(input, "Shift_JIS");
-	} catch( boost::locale::conv::conversion_error&e ) {
-		const char *p = input.data();
-		std::string output;
-		while (*p)
-			{
-				uint16 uc = mac_roman_to_unicode(*p++);
-				unicode_to_utf8(uc, output);
-			}
-		
-		return output;
-	}
+	const char* begin = input.data();
+	const char* end = begin + input.size();
+	if (skip_ascii(begin, end) != end && is_shift_jis(begin, end))
+		return TextConverter(TextConverter::kShiftJIS).ToUTF8(input);
+	else
+		return TextConverter(TextConverter::kMacRoman).ToUTF8(input);
 }
 
 std::string utf8_to_mac_roman(const std::string& input)
 {
-	try {
-		return conv::from_utf<char>(input, "Shift_JIS");
-	} catch( boost::locale::conv::conversion_error&e ) {
-		const char *p = input.data();
-		std::string output;
-		while (*p)
-			{
-				int advance = 0;
-				uint16 uc = utf8_to_unicode(p, advance);
-				output += unicode_to_mac_roman(uc);
-				p += advance;
-			}
-		
-		return output;
-	}
+	const char* begin = input.data();
+	const char* end = begin + input.size();
+	if (all_mac_roman(begin, end))
+		return TextConverter(TextConverter::kMacRoman).FromUTF8(input);
+	else
+		return TextConverter(TextConverter::kShiftJIS).FromUTF8(input);
 }
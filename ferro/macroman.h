@@ -25,6 +25,67 @@
 
 #include <string>
 
+namespace marathon
+{
+	// converts between UTF-8 and the 8-bit encoding a scenario's
+	// strings are in; the pointer versions append to output
+	class TextConverter
+	{
+	public:
+		enum Encoding {
+			kMacRoman,
+			kShiftJIS
+		};
+
+		TextConverter(Encoding encoding = kMacRoman) : encoding_(encoding) { }
+		Encoding encoding() const { return encoding_; }
+
+		void ToUTF8(const char* begin, const char* end, std::string& output) const;
+		void FromUTF8(const char* begin, const char* end, std::string& output) const;
+
+		std::string ToUTF8(const std::string& input) const;
+		std::string FromUTF8(const std::string& input) const;
+
+	private:
+		Encoding encoding_;
+	};
+
+	// whether every byte above 0x7f is part of a well formed Shift_JIS
+	// character
+	bool is_shift_jis(const char* begin, const char* end);
+
+	// decides on one encoding for a whole scenario from samples of its
+	// text; each sample with anything besides ASCII is a vote
+	class EncodingDetector
+	{
+	public:
+		EncodingDetector() : mac_roman_(0), shift_jis_(0) { }
+
+		// text as the scenario stores it; it only counts for Shift_JIS
+		// if it has two byte characters, since MacRoman punctuation
+		// often passes for half-width katakana
+		void Sample(const char* begin, const char* end);
+		void Sample(const std::string& text) { Sample(text.data(), text.data() + text.size()); }
+
+		// UTF-8 text that is going into the scenario
+		void SampleUTF8(const char* begin, const char* end);
+		void SampleUTF8(const std::string& text) { SampleUTF8(text.data(), text.data() + text.size()); }
+
+		int samples() const { return mac_roman_ + shift_jis_; }
+
+		// MacRoman unless most samples are Shift_JIS
+		TextConverter::Encoding encoding() const { return shift_jis_ > mac_roman_ ? TextConverter::kShiftJIS : TextConverter::kMacRoman; }
+
+	private:
+		int mac_roman_;
+		int shift_jis_;
+	};
+}
+
+// these pick an encoding for each string by itself: ASCII, and text
+// that can't be Shift_JIS, is MacRoman; where the whole scenario is at
+// hand, a TextConverter for Unimap::text_encoding() is faster and
+// treats every string alike
 std::string mac_roman_to_utf8(const std::string& input);
 std::string utf8_to_mac_roman(const std::string& input);
 
@@ -32,11 +32,16 @@
 #include "ferro/Unimap.h"
 
 #include "filesystem.h"
+#include "parallel.h"
 #include "CLUTResource.h"
 #include "PICTResource.h"
 #include "SndResource.h"
 
+#include <exception>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <iterator>
 #include <map>
 #include <sstream>
 #include <string>
@@ -73,7 +78,7 @@ static std::vector<uint8> ReadFile(const std::string& path)
 void MergePhysics(const fs::path& path, marathon::Wad& wad, std::ostream& log)
 {
 	marathon::Unimap wadfile;
-	if (wadfile.Open(path.string()))
+	if (wadfile.OpenMapped(path.string()))
 	{
 		// check to make sure all physics are present
 		marathon::Wad physics = wadfile.GetWad(0);
@@ -115,12 +120,12 @@ void MergeShapes(const fs::path& path, marathon::Wad& wad, std::ostream& log)
 	}
 }
 
-void MergeTerminal(const fs::path& path, marathon::Wad& wad, std::ostream& log)
+void MergeTerminal(const fs::path& path, marathon::Wad& wad, const marathon::TextConverter& converter, std::ostream& log)
 {
 	try 
 	{
 		marathon::TerminalChunk chunk;
-		chunk.Compile(path.string());
+		chunk.Compile(path.string(), converter);
 		wad.AddChunk(marathon::TerminalChunk::kTag, chunk.Save());
 	}
 	catch (const marathon::TerminalChunk::ParseError& e)
@@ -155,17 +160,23 @@ struct SortScriptPaths
 	}
 };
 
-marathon::Wad CreateWad(const fs::path& path, std::ostream& log)
+// the files that make up one level folder
+struct LevelFiles
 {
-	marathon::Wad wad;
-
+	fs::path path;
 	std::vector<fs::path> maps;
 	std::vector<fs::path> physics;
 	std::vector<fs::path> shapes;
 	std::vector<fs::path> terminals;
 	std::vector<fs::path> luas;
 	std::vector<fs::path> mmls;
-	
+};
+
+LevelFiles FindLevelFiles(const fs::path& path)
+{
+	LevelFiles files;
+	files.path = path;
+
 	std::vector<fs::path> dir = path.ls();	
 	for (std::vector<fs::path>::iterator it = dir.begin(); it != dir.end(); ++it)
 	{
@@ -176,69 +187,164 @@ marathon::Wad CreateWad(const fs::path& path, std::ostream& log)
 
 		std::string extension = fs::extension(it->filename());
 		if (extension == ".sceA")
-			maps.push_back(*it);
+			files.maps.push_back(*it);
 		else if (extension == ".phyA")
-			physics.push_back(*it);
+			files.physics.push_back(*it);
 		else if (extension == ".ShPa")
-			shapes.push_back(*it);
+			files.shapes.push_back(*it);
 		else if (extension == ".txt")
-			terminals.push_back(*it);
+			files.terminals.push_back(*it);
 		else if (extension == ".lua")
-			luas.push_back(*it);
+			files.luas.push_back(*it);
 		else if (extension == ".mml")
-			mmls.push_back(*it);
+			files.mmls.push_back(*it);
 	}
 
-	if (maps.size())
+	if (!files.maps.size())
 	{
-		if (maps.size() > 1)
-			log << path.string() << ": multiple maps found; using " << maps[0].string() << std::endl;
+		throw merge_error(path.string() + " does not contain a map");
+	}
 
-		marathon::Unimap wadfile;
-		if (wadfile.Open(maps[0].string()) && wadfile.data_version() == 1)
-		{
-			wad = wadfile.GetWad(0);
+	return files;
+}
 
-			
-			if (physics.size())
-			{
-				if (physics.size() > 1)
-					log << path.string() << ": multiple physics models found; using " << physics[0].string() << std::endl;
+marathon::Wad CreateWad(LevelFiles files, const marathon::TextConverter& converter, std::ostream& log)
+{
+	marathon::Wad wad;
 
-				MergePhysics(physics[0], wad, log);
-			}
-			if (shapes.size())
-			{
-				if (shapes.size() > 1)
-					log << path.string() << ": multiple shapes patches found; using " << shapes[0].string() << std::endl;
-				MergeShapes(shapes[0], wad, log);
-			}
-			if (terminals.size())
-			{
-				if (terminals.size() > 1)
-					log << path.string() << ": multiple terminal texts files found; using " << terminals[0].string() << std::endl;
-				MergeTerminal(terminals[0], wad, log);
-			}
-			if (luas.size())
-			{
-				std::sort(luas.begin(), luas.end(), SortScriptPaths());
-				MergeScripts(luas, wad, marathon::ScriptChunk::kLuaTag);
-			}
-			if (mmls.size())
-			{
-				std::sort(mmls.begin(), mmls.end(), SortScriptPaths());
-				MergeScripts(mmls, wad, marathon::ScriptChunk::kMMLTag);
-			}
-		}
-	}
-	else
+	const fs::path& path = files.path;
+	std::vector<fs::path>& maps = files.maps;
+	std::vector<fs::path>& physics = files.physics;
+	std::vector<fs::path>& shapes = files.shapes;
+	std::vector<fs::path>& terminals = files.terminals;
+	std::vector<fs::path>& luas = files.luas;
+	std::vector<fs::path>& mmls = files.mmls;
+
+	if (maps.size() > 1)
+		log << path.string() << ": multiple maps found; using " << maps[0].string() << std::endl;
+
+	marathon::Unimap wadfile;
+	if (wadfile.OpenMapped(maps[0].string()) && wadfile.data_version() == 1)
 	{
-		throw merge_error(path.string() + " does not contain a map");
+		wad = wadfile.GetWad(0);
+
+		
+		if (physics.size())
+		{
+			if (physics.size() > 1)
+				log << path.string() << ": multiple physics models found; using " << physics[0].string() << std::endl;
+
+			MergePhysics(physics[0], wad, log);
+		}
+		if (shapes.size())
+		{
+			if (shapes.size() > 1)
+				log << path.string() << ": multiple shapes patches found; using " << shapes[0].string() << std::endl;
+			MergeShapes(shapes[0], wad, log);
+		}
+		if (terminals.size())
+		{
+			if (terminals.size() > 1)
+				log << path.string() << ": multiple terminal texts files found; using " << terminals[0].string() << std::endl;
+			MergeTerminal(terminals[0], wad, converter, log);
+		}
+		if (luas.size())
+		{
+			std::sort(luas.begin(), luas.end(), SortScriptPaths());
+			MergeScripts(luas, wad, marathon::ScriptChunk::kLuaTag);
+		}
+		if (mmls.size())
+		{
+			std::sort(mmls.begin(), mmls.end(), SortScriptPaths());
+			MergeScripts(mmls, wad, marathon::ScriptChunk::kMMLTag);
+		}
 	}
 	
 	return wad;
 }
 
+// builds levels on worker threads a few at a time, just ahead of Save
+// asking for them in order, so only about jobs finished wads are ever
+// held in memory; each level's log is passed on the first time its wad
+// is. Save to a stream asks for every level twice, so going back to an
+// earlier level starts over from there
+class LevelBuilder
+{
+public:
+	LevelBuilder(const std::vector<LevelFiles>& levels, const marathon::TextConverter& converter, int jobs, std::ostream& log) : levels_(levels), converter_(converter), jobs_(jobs > 0 ? jobs : default_jobs()), log_(log), next_(0), logged_(0) { }
+
+	marathon::Wad Build(std::size_t i)
+	{
+		if (i < next_ && !pending_.count(i))
+		{
+			pending_.clear();
+			next_ = i;
+		}
+
+		while (next_ < levels_.size() && next_ < i + jobs_)
+		{
+			pending_[next_] = std::async(std::launch::async, &LevelBuilder::BuildLevel, levels_[next_], converter_);
+			++next_;
+		}
+
+		Level level;
+		std::map<std::size_t, std::future<Level> >::iterator it = pending_.find(i);
+		if (it != pending_.end())
+		{
+			level = it->second.get();
+			pending_.erase(it);
+		}
+		else
+		{
+			level = BuildLevel(levels_[i], converter_);
+		}
+
+		if (i >= logged_)
+		{
+			log_ << level.log;
+			logged_ = i + 1;
+		}
+
+		if (level.error)
+			std::rethrow_exception(level.error);
+
+		return std::move(level.wad);
+	}
+
+private:
+	struct Level
+	{
+		marathon::Wad wad;
+		std::string log;
+		std::exception_ptr error;
+	};
+
+	static Level BuildLevel(const LevelFiles& files, const marathon::TextConverter& converter)
+	{
+		Level level;
+		std::ostringstream log;
+		try
+		{
+			level.wad = CreateWad(files, converter, log);
+		}
+		catch (...)
+		{
+			level.error = std::current_exception();
+		}
+		level.log = log.str();
+		return level;
+	}
+
+	const std::vector<LevelFiles>& levels_;
+	marathon::TextConverter converter_;
+	std::size_t jobs_;
+	std::ostream& log_;
+
+	std::size_t next_;
+	std::map<std::size_t, std::future<Level> > pending_;
+	std::size_t logged_;
+};
+
 void MergeCLUTs(marathon::Unimap& wadfile, const fs::path& path)
 {
 	std::vector<fs::path> dir = path.ls();
@@ -360,7 +466,30 @@ static std::string get_line(std::istream& stream)
 }
 
 
-void atque::merge(const std::string& src, const std::string& dest, std::ostream& log)
+// MacRoman, unless the level names and terminal scripts are mostly
+// text that only Shift_JIS can hold
+static marathon::TextConverter::Encoding detect_encoding(const std::map<int16, std::string>& level_names, const std::vector<LevelFiles>& levels)
+{
+	marathon::EncodingDetector detector;
+	for (std::map<int16, std::string>::const_iterator it = level_names.begin(); it != level_names.end(); ++it)
+	{
+		detector.SampleUTF8(it->second);
+	}
+
+	for (std::vector<LevelFiles>::const_iterator it = levels.begin(); it != levels.end(); ++it)
+	{
+		if (it->maps.size() && it->terminals.size())
+		{
+			std::ifstream s(it->terminals[0].string().c_str(), std::ios::binary);
+			detector.SampleUTF8(std::string(std::istreambuf_iterator<char>(s), std::istreambuf_iterator<char>()));
+		}
+	}
+
+	return detector.encoding();
+}
+
+// builds the scenario in src, then hands it to save
+static void merge_scenario(const std::string& src, const std::string& name, std::ostream& log, int jobs, const std::function<void (marathon::Wadfile&)>& save)
 {
 	if (!fs::exists(src))
 	{
@@ -391,6 +520,8 @@ void atque::merge(const std::string& src, const std::string& dest, std::ostream&
 		}
 	}
 
+	std::map<int16, LevelFiles> level_files;
+
 	std::vector<fs::path> dir = fs::path(src).ls();
 	for (std::vector<fs::path>::iterator it = dir.begin(); it != dir.end(); ++it)
 	{
@@ -414,22 +545,55 @@ void atque::merge(const std::string& src, const std::string& dest, std::ostream&
 					{
 						std::string level_name;
 						std::getline(s, level_name);
-						wadfile.SetWad(index, CreateWad(*it, log));
+						level_files[index] = FindLevelFiles(*it);
 					} 
 				}
 			}
 		}
 	}
 
+	// Save asks for wads in index order, which is the order of
+	// level_files
+	std::vector<LevelFiles> levels;
+	for (std::map<int16, LevelFiles>::const_iterator it = level_files.begin(); it != level_files.end(); ++it)
+	{
+		levels.push_back(it->second);
+	}
+
+	// names and terminals are all written in one encoding
+	marathon::TextConverter converter(detect_encoding(level_select_names, levels));
+
+	LevelBuilder builder(levels, converter, jobs, log);
+	std::size_t i = 0;
+	for (std::map<int16, LevelFiles>::const_iterator it = level_files.begin(); it != level_files.end(); ++it, ++i)
+	{
+		wadfile.SetWad(it->first, std::bind(&LevelBuilder::Build, &builder, i));
+	}
+
 	for (std::map<int16, std::string>::iterator it = level_select_names.begin(); it != level_select_names.end(); ++it)
 	{
 		if (wadfile.HasWad(it->first))
 		{
-			wadfile.SetLevelName(it->first, utf8_to_mac_roman(it->second));
+			wadfile.SetLevelName(it->first, converter.FromUTF8(it->second));
 		}
 	}
 
-	wadfile.file_name(fs::basename(fs::path(dest).filename()));
-	wadfile.Save(dest);
-	
+	wadfile.file_name(name);
+	save(wadfile);
+}
+
+void atque::merge(const std::string& src, const std::string& dest, std::ostream& log, int jobs)
+{
+	merge_scenario(src, fs::basename(fs::path(dest).filename()), log, jobs, [&](marathon::Wadfile& wadfile) {
+		if (!wadfile.Save(dest))
+			throw merge_error("error writing " + dest);
+	});
+}
+
+void atque::merge(const std::string& src, std::ostream& dest, const std::string& name, std::ostream& log, int jobs)
+{
+	merge_scenario(src, name, log, jobs, [&](marathon::Wadfile& wadfile) {
+		if (!wadfile.Save(dest))
+			throw merge_error("error writing " + name);
+	});
 }
@@ -34,7 +34,14 @@ namespace atque
 		merge_error(const std::string& what) : std::runtime_error(what) { }
 	};
 
-	void merge(const std::string& source, const std::string& destination, std::ostream& log);
+	// levels are built on up to jobs threads (all cores if jobs <= 0)
+	void merge(const std::string& source, const std::string& destination, std::ostream& log, int jobs = 0);
+
+	// writes the scenario to destination strictly in order, so it can
+	// be a pipe; name is the file name stored in the header. Each level
+	// is built twice, once to measure it and once to write it, but no
+	// more levels are held in memory than when writing to a file
+	void merge(const std::string& source, std::ostream& destination, const std::string& name, std::ostream& log, int jobs = 0);
 }
 
 #endif
@@ -0,0 +1,104 @@
+/* parallel.h
+
+   Copyright (C) 2008 by Gregory Smith
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   This license is contained in the file "COPYING", which is included
+   with this source code; it is available online at
+   http://www.gnu.org/licenses/gpl.html
+
+*/
+
+/*
+  Runs independent jobs on a small pool of threads
+*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace atque
+{
+	// number of threads to use when the caller asks for jobs <= 0
+	inline int default_jobs()
+	{
+		unsigned int n = std::thread::hardware_concurrency();
+		return n ? n : 1;
+	}
+
+	// calls f(0) ... f(count - 1), spread over up to jobs threads (all
+	// cores if jobs <= 0); each index is run exactly once, in no
+	// particular order. If any calls throw, the exception from the
+	// lowest index is rethrown after every thread has finished, so
+	// errors are reported the same way a serial loop would report them
+	template <class F>
+	void parallel_for(std::size_t count, int jobs, F f)
+	{
+		if (jobs <= 0)
+			jobs = default_jobs();
+		if (static_cast<std::size_t>(jobs) > count)
+			jobs = count;
+
+		if (jobs <= 1)
+		{
+			for (std::size_t i = 0; i < count; ++i)
+				f(i);
+			return;
+		}
+
+		std::atomic<std::size_t> next(0);
+		std::vector<std::exception_ptr> errors(count);
+
+		auto worker = [&]() {
+			for (std::size_t i = next++; i < count; i = next++)
+			{
+				try
+				{
+					f(i);
+				}
+				catch (...)
+				{
+					errors[i] = std::current_exception();
+				}
+			}
+		};
+
+		// if a thread can't be started, the ones that were, and this
+		// one, take the rest of the indexes; none are left unjoined
+		std::vector<std::thread> threads;
+		threads.reserve(jobs - 1);
+		try
+		{
+			for (int i = 1; i < jobs; ++i)
+				threads.push_back(std::thread(worker));
+		}
+		catch (const std::exception&)
+		{
+		}
+		worker();
+		for (std::vector<std::thread>::iterator it = threads.begin(); it != threads.end(); ++it)
+			it->join();
+
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			if (errors[i])
+				std::rethrow_exception(errors[i]);
+		}
+	}
+}
+
+#endif
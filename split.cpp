@@ -31,14 +31,16 @@
 
 #include "split.h"
 #include "filesystem.h"
-#include "CLUTResource.h"
+#include "parallel.h"
 #include "PICTResource.h"
-#include "SndResource.h"
 
+#include <array>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
 #include <set>
+#include <atomic>
+#include <mutex>
 
 #include <boost/assign/list_of.hpp>
 #include <algorithm>
@@ -126,11 +128,11 @@ void SaveShapes(marathon::Wad& wad, const std::string& path)
 	const uint32 shapes_tag = FOUR_CHARS_TO_INT('S','h','P','a');
 	if (wad.HasChunk(shapes_tag))
 	{
-		const std::vector<uint8>& data = wad.GetChunk(shapes_tag);
+		marathon::ByteView data = wad.GetChunk(shapes_tag);
 		if (data.size())
 		{
 			std::ofstream outfile(path.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
-			outfile.write(reinterpret_cast<const char*>(&data[0]), data.size());
+			outfile.write(reinterpret_cast<const char*>(data.data()), data.size());
 			set_type_code(path, "ShPa");
 		}
 		wad.RemoveChunk(shapes_tag);
@@ -182,15 +184,6 @@ void SaveScripts(marathon::Wad& wad, const fs::path& dir)
 
 }
 
-std::string getTEXT(marathon::Unimap& wad, marathon::Unimap::ResourceIdentifier id) {
-	const std::vector<uint8>& data = wad.GetResource(id);	
-	if (data.size())
-	{
-		return std::string(data.begin(), data.end());
-	}
-	return "";
-}
-
 void SaveTerminal(marathon::TerminalChunk& chunk, marathon::Wad& wad)
 {
 	if (wad.HasChunk(marathon::TerminalChunk::kTag))
@@ -255,7 +248,145 @@ static std::string sanitize(const std::string& input)
 	return result;
 }
 
-void atque::split(Resources& rsrc, const std::string& src, const std::string& dest, std::ostream& log)
+// appends text [begin, end) to the level's text as one run
+static void AddRun(LevelTerminals& out, const marathon::TextConverter& converter, char color, uint8 face, const uint8* begin, const uint8* end)
+{
+	std::size_t offset = out.text.size();
+	converter.ToUTF8(reinterpret_cast<const char*>(begin), reinterpret_cast<const char*>(end), out.text);
+	std::replace( out.text.begin() + offset, out.text.end(), '\r', '\n' );
+	out.run_offsets.push_back( out.text.size() );
+	out.run_colors.push_back( color );
+	out.run_faces.push_back( face );
+}
+
+// decodes the terminals of one level, walking each terminal's text and
+// font changes once; runs are converted straight into the level's text
+static void SplitLevel(marathon::Wad& wad, const marathon::TextConverter& converter, int num, LevelTerminals& out)
+{
+	try {
+		marathon::MapInfo minf(wad.GetChunk(marathon::MapInfo::kTag));
+
+		marathon::TerminalChunk terminals;
+		SaveTerminal(terminals, wad);
+
+		out = LevelTerminals();
+		std::size_t text_size = 0, runs = 0, pages = 0;
+		for( const auto& term : terminals.terminal_texts_ ) {
+			text_size += term.text_.size();
+			runs += term.font_changes_.size() + term.groupings_.size();
+			pages += term.groupings_.size();
+		}
+		out.text.reserve( text_size + text_size / 4 );
+		out.run_offsets.reserve( runs + 1 );
+		out.run_colors.reserve( runs );
+		out.run_faces.reserve( runs );
+		out.page_types.reserve( pages );
+		out.page_permutations.reserve( pages );
+		out.page_flags.reserve( pages );
+		out.page_first_runs.reserve( pages );
+		out.page_end_runs.reserve( pages );
+		out.groups.reserve( terminals.terminal_texts_.size() * 3 + 1 );
+
+		// pages come in any group order; they're collected here, then
+		// appended a group at a time
+		struct Page {
+			int16 type;
+			int16 permutation;
+			int16 flags;
+			uint32 first_run;
+			uint32 end_run;
+		};
+		std::array<std::vector<Page>, 3> by_group;
+		for( auto& term : terminals.terminal_texts_ ) {
+			term.DecodeText();
+			for( auto& group : by_group ) {
+				group.clear();
+			}
+
+			auto font_iter = term.font_changes_.cbegin();
+			char color = 0;
+			uint8 face = 0;
+			int gp = 0;
+			for( const auto& g : term.groupings_ ) {
+				std::size_t text_start = out.text.size();
+				uint32 first_run = out.run_colors.size();
+				std::size_t end = std::min<std::size_t>( term.text_.size(), g.start_index_ + g.length_ );
+
+				// the text is NUL terminated, and the last group's length
+				// takes the terminator in; nothing after it is shown, but
+				// font changes past it still apply to later groups
+				std::size_t text_end = end;
+				if( g.start_index_ < end ) {
+					text_end = std::find( term.text_.begin() + g.start_index_, term.text_.begin() + end, 0 ) - term.text_.begin();
+				}
+				for( std::size_t i = g.start_index_; i < end; ) {
+					if( font_iter != term.font_changes_.end() && static_cast<int>(i) == font_iter->index_ ) {
+						color = font_iter->color_;
+						face = font_iter->face_ & (marathon::FontChange::kBold | marathon::FontChange::kItalic | marathon::FontChange::kUnderline);
+						++font_iter;
+						continue;
+					}
+
+					std::size_t run_end = end;
+					if( font_iter != term.font_changes_.end() && font_iter->index_ > static_cast<int>(i) ) {
+						run_end = std::min<std::size_t>( run_end, font_iter->index_ );
+					}
+					if( i < text_end ) {
+						AddRun( out, converter, color, face, &term.text_[i], &term.text_[0] + std::min( run_end, text_end ) );
+					}
+					i = run_end;
+				}
+
+				switch( g.type_ ) {
+				case marathon::TerminalGrouping::kUnfinished :
+					gp = 0;
+					break;
+				case marathon::TerminalGrouping::kSuccess :
+					gp = 1;
+					break;
+				case marathon::TerminalGrouping::kFailure :
+					gp = 2;
+					break;
+				default:
+					by_group[gp].push_back( Page{ g.type_, g.permutation_, g.flags_, first_run, static_cast<uint32>(out.run_colors.size()) } );
+					continue;
+				}
+
+				// the group markers aren't pages
+				out.run_offsets.resize( first_run + 1 );
+				out.run_colors.resize( first_run );
+				out.run_faces.resize( first_run );
+				out.text.resize( text_start );
+			}
+
+			for( const auto& group : by_group ) {
+				for( const auto& pg : group ) {
+					out.page_types.push_back( pg.type );
+					out.page_permutations.push_back( pg.permutation );
+					out.page_flags.push_back( pg.flags );
+					out.page_first_runs.push_back( pg.first_run );
+					out.page_end_runs.push_back( pg.end_run );
+				}
+				out.groups.push_back( out.page_types.size() );
+			}
+		}
+
+		// the reservations above were upper bounds, and the level is
+		// kept for as long as it's viewed
+		out.text.shrink_to_fit();
+		out.run_offsets.shrink_to_fit();
+		out.run_colors.shrink_to_fit();
+		out.run_faces.shrink_to_fit();
+	}
+	catch (const std::exception&)
+	{
+		std::ostringstream error;
+		error << "error writing level " << num << "; aborting";
+		throw split_error(error.str());
+	}
+}
+
+void atque::split(Resources& rsrc, const std::string& src, std::ostream& log, int jobs, SplitProgress* progress)
 {
 	if (!fs::exists(src))
 	{
@@ -263,138 +394,79 @@ void atque::split(Resources& rsrc, const std::string& src, const std::string& de
 	}
 	
 	marathon::Unimap wadfile;
-	if (!wadfile.Open(src.c_str()) or wadfile.data_version() < 1)
+	if (!wadfile.OpenMapped(src) or wadfile.data_version() < 1)
 	{
 		throw split_error("input must be a Marathon 2 or Infinity scenario");
 	}
 
-	std::map<int16, std::string> level_select_names;
+	// every string in the scenario is in the one encoding
+	marathon::TextConverter converter(wadfile.text_encoding());
+	rsrc.converter = converter;
 
+	// the Unimap is not thread safe, so pull everything out of it
+	// first; since the file is mapped this only parses chunk headers
 	std::vector<int16> indexes = wadfile.GetWadIndexes();
+	std::vector<marathon::Wad> wads;
+	SplitCounts counts = { 0, 0, 0, 0 };
+	std::vector<std::size_t> level_bytes;
 	for (std::vector<int16>::iterator it = indexes.begin(); it != indexes.end(); ++it)
 	{
-		Levels lv;
 		marathon::Wad wad = wadfile.GetWad(*it);
 		if (wad.HasChunk(marathon::MapInfo::kTag))
 		{
-			try {
-				marathon::MapInfo minf(wad.GetChunk(marathon::MapInfo::kTag));
-				
-				lv.num = *it;
-				lv.name = mac_roman_to_utf8( wadfile.GetLevelName(*it) );
-				marathon::TerminalChunk terminals;
-				SaveTerminal(terminals, wad);
-				for( auto& term : terminals.terminal_texts_ ) {
-					if( term.flags_ & marathon::TerminalText::kTextIsEncoded ) {
-						uint8 *p = &term.text_[0];
-						for (int i = 0; i < term.text_.size() / 4; ++i) {
-							p += 2;
-							*p++ ^= 0xfe;
-							*p++ ^= 0xed;
-						}
-						for (int i = 0; i < term.text_.size() % 4; ++i) {
-							*p++ ^= 0xfe;
-						}
-					}
-					std::array<std::vector<TermPage>, 3> page;
-					auto font_iter = term.font_changes_.cbegin();
-					TermRichText tr = { "", 0, false, false, false };
-					int gp = 0;
-					for( unsigned int j = 0; j <  term.groupings_.size(); ++j ) {
-						const auto& g = term.groupings_[j];
-						std::string txt = "";
-						TermPage pg = { g.type_, g.permutation_, g.flags_, {} };
-						for(unsigned int i = g.start_index_; i < term.text_.size() && i < g.start_index_ + g.length_;  ) {
-							if( font_iter != term.font_changes_.end() && i == font_iter->index_ ) {
-								tr.text = mac_roman_to_utf8( txt );
-								pg.line.push_back(tr);
-								tr.color = font_iter->color_;
-								tr.b = font_iter->face_ & marathon::FontChange::kBold;
-								tr.i = font_iter->face_ & marathon::FontChange::kItalic;
-								tr.u = font_iter->face_ & marathon::FontChange::kUnderline;
-								++font_iter;
-								txt.clear();
-								continue;
-							}
-							
-							if( term.text_[i] == '\r' ) {
-								i++;
-								txt += "\n";
-							} else {
-								txt += (char)term.text_[i++];
-							}
-						}
-						if( ! txt.empty() ) {
-							tr.text = mac_roman_to_utf8( txt );
-							pg.line.push_back( tr );
-							txt.clear();
-						}
-						
-						switch( g.type_ ) {
-						case marathon::TerminalGrouping::kUnfinished :
-							gp = 0;
-							continue;
-						case marathon::TerminalGrouping::kSuccess :
-							gp = 1;
-							continue;
-						case marathon::TerminalGrouping::kFailure :
-							gp = 2;
-							continue;
-						}
-						page[gp].push_back( pg );
-					}
-					lv.pages.push_back( page );
-
-				}
-				rsrc.levels.push_back( lv );
-			}
-			catch (const std::exception&)
-			{
-				std::ostringstream error;
-				error << "error writing level " << *it << "; aborting";
-				throw split_error(error.str());
-			}
-
+			rsrc.level_nums.push_back(*it);
+			rsrc.level_names.push_back(converter.ToUTF8(wadfile.GetLevelName(*it)));
+			wads.push_back(wad);
+			level_bytes.push_back(wad.GetChunkData(marathon::TerminalChunk::kTag).size());
+			counts.bytes += level_bytes.back();
 		}
 	}
+	counts.levels = wads.size();
 
-	std::map<int16, std::string> resource_names;
-
-	std::vector<marathon::Unimap::ResourceIdentifier> resources = wadfile.GetResourceIdentifiers();
-	for (std::vector<marathon::Unimap::ResourceIdentifier>::const_iterator it = resources.begin(); it != resources.end(); ++it)
+	// resources are only handles into the file; pictures and texts
+	// are read and decoded when they're looked at
+	std::vector<marathon::Unimap::ResourceIdentifier> ids = wadfile.GetResourceIdentifiers();
+	for (std::vector<marathon::Unimap::ResourceIdentifier>::const_iterator it = ids.begin(); it != ids.end(); ++it)
 	{
-
-		if (it->first == FOUR_CHARS_TO_INT('P','I','C','T') || it->first == FOUR_CHARS_TO_INT('p','i','c','t'))
+		if (it->first == FOUR_CHARS_TO_INT('P','I','C','T'))
 		{
-			auto pict = std::make_shared<PICTResource>();
-			if (it->first == FOUR_CHARS_TO_INT('P','I','C','T'))
-			{
-				pict->Load(wadfile.GetResource(*it));
-			}
-			else
-			{
-				pict->LoadRaw(wadfile.GetResource(*it), wadfile.GetResource(marathon::Unimap::ResourceIdentifier(FOUR_CHARS_TO_INT('c','l','u','t'), it->second)));
-			}
-
-			if (! pict->IsUnparsed()) {
-				rsrc.picts[ it->second ] = pict;
-			}
-
+			rsrc.picts[ it->second ] = LazyPICT(false, wadfile.GetResourceData(*it), marathon::ChunkData());
 		}
-		else if (it->first == FOUR_CHARS_TO_INT('T','E','X','T') || it->first == FOUR_CHARS_TO_INT('t','e','x','t'))
-		{
-			rsrc.texts[ it->second ] = getTEXT( wadfile, *it);
-		}
-		else if (it->first == FOUR_CHARS_TO_INT('c','l','u','t'))
+		else if (it->first == FOUR_CHARS_TO_INT('p','i','c','t'))
 		{
-			CLUTResource clut(wadfile.GetResource(*it));
-//			clut.Export(clut_path.string());
+			rsrc.picts[ it->second ] = LazyPICT(true, wadfile.GetResourceData(*it), wadfile.GetResourceData(marathon::Unimap::ResourceIdentifier(FOUR_CHARS_TO_INT('c','l','u','t'), it->second)));
 		}
-		else if (it->first == FOUR_CHARS_TO_INT('s','n','d',' '))
+		else if (it->first == FOUR_CHARS_TO_INT('T','E','X','T') || it->first == FOUR_CHARS_TO_INT('t','e','x','t'))
 		{
-			SndResource snd(wadfile.GetResource(*it));
-//			snd.Export(snd_path.string());
+			rsrc.texts[ it->second ] = wadfile.GetResourceData(*it);
 		}
 	}
 
+	rsrc.level_terminals.resize(wads.size());
+	if (progress)
+		progress->Started(rsrc);
+
+	// each level only touches its own entry; log lines and progress
+	// calls are serialized, and once one asks to cancel the remaining
+	// levels are skipped
+	std::mutex progress_mutex;
+	std::atomic<bool> cancelled(false);
+	parallel_for(wads.size(), jobs, [&](std::size_t i) {
+		if (cancelled)
+			return;
+
+		SplitLevel(wads[i], converter, rsrc.level_nums[i], rsrc.level_terminals[i]);
+
+		std::lock_guard<std::mutex> lock(progress_mutex);
+		log << "Level " << rsrc.level_nums[i] << " (" << rsrc.level_names[i] << "): " << rsrc.level_terminals[i].terminal_count() << " terminals" << std::endl;
+		++counts.levels_done;
+		counts.bytes_done += level_bytes[i];
+		if (progress && !cancelled && !progress->LevelDone(rsrc, i, counts))
+			cancelled = true;
+	});
+
+	if (cancelled)
+	{
+		throw split_cancelled();
+	}
 }
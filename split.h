@@ -25,32 +25,149 @@
 #include <string>
 #include <memory>
 #include <unordered_map>
-#include <wx/bitmap.h>
+#include <vector>
 #include "ferro/TerminalChunk.h"
 #include "PICTResource.h"
 namespace atque 
 {
-struct TermRichText {
-	std::string text;
-	char color;
-	bool b, i, u;
+class LevelTerminals;
+
+// views of one run or page of a LevelTerminals, which must outlive them
+
+// text in one style
+class TermRun {
+public:
+	TermRun(const LevelTerminals& terminals, uint32 index) : terminals_(&terminals), index_(index) { }
+
+	// UTF-8
+	const char* begin() const;
+	const char* end() const;
+
+	char color() const;
+	bool bold() const;
+	bool italic() const;
+	bool underline() const;
+
+private:
+	const LevelTerminals* terminals_;
+	uint32 index_;
 };
-struct TermPage {
-	int16 type;
-	int permutation;
-	int flags;
-	std::vector<TermRichText> line;
+
+// views of items [first, last) of a LevelTerminals
+template <class View>
+class TermRange {
+public:
+	class iterator {
+	public:
+		iterator(const LevelTerminals& terminals, uint32 index) : terminals_(&terminals), index_(index) { }
+		View operator*() const { return View(*terminals_, index_); }
+		iterator& operator++() { ++index_; return *this; }
+		bool operator==(const iterator& other) const { return index_ == other.index_; }
+		bool operator!=(const iterator& other) const { return index_ != other.index_; }
+	private:
+		const LevelTerminals* terminals_;
+		uint32 index_;
+	};
+
+	TermRange(const LevelTerminals& terminals, uint32 first, uint32 last) : terminals_(&terminals), first_(first), last_(last) { }
+
+	iterator begin() const { return iterator(*terminals_, first_); }
+	iterator end() const { return iterator(*terminals_, last_); }
+	std::size_t size() const { return last_ - first_; }
+	bool empty() const { return first_ == last_; }
+	View operator[](std::size_t index) const { return View(*terminals_, first_ + index); }
+
+private:
+	const LevelTerminals* terminals_;
+	uint32 first_;
+	uint32 last_;
 };
-struct Levels {
-	int num;
-	std::string name;
-	std::vector<std::array<std::vector<TermPage>, 3>> pages; // unifnished, finished, failure
 
+class TermPage {
+public:
+	TermPage(const LevelTerminals& terminals, uint32 index) : terminals_(&terminals), index_(index) { }
+
+	// within the level
+	uint32 index() const { return index_; }
+
+	int16 type() const;
+	int permutation() const;
+	int flags() const;
+	TermRange<TermRun> runs() const;
+
+private:
+	const LevelTerminals* terminals_;
+	uint32 index_;
+};
+
+typedef TermRange<TermPage> TermGroup;
+
+// a level's terminals, as a structure of arrays: runs are consecutive
+// pieces of text, pages are ranges of runs, and groups are ranges of
+// pages. The pages are sorted by terminal and then by group
+// (unfinished, finished, failure)
+struct LevelTerminals {
+	std::string text;
+
+	// run r is text [run_offsets[r], run_offsets[r + 1])
+	std::vector<uint32> run_offsets;
+	std::vector<char> run_colors;
+	std::vector<uint8> run_faces; // FontChange::kBold etc.
+
+	// page p is runs [page_first_runs[p], page_end_runs[p])
+	std::vector<int16> page_types;
+	std::vector<int16> page_permutations;
+	std::vector<int16> page_flags;
+	std::vector<uint32> page_first_runs;
+	std::vector<uint32> page_end_runs;
+
+	// group g of terminal t is pages [groups[t * 3 + g], groups[t * 3 + g + 1])
+	std::vector<uint32> groups;
+
+	LevelTerminals() : run_offsets(1, 0), groups(1, 0) { }
+
+	std::size_t terminal_count() const { return groups.size() / 3; }
+	TermGroup group(std::size_t terminal, int group) const { return TermGroup(*this, groups[terminal * 3 + group], groups[terminal * 3 + group + 1]); }
+	TermPage page(uint32 index) const { return TermPage(*this, index); }
+};
+
+inline const char* TermRun::begin() const { return terminals_->text.data() + terminals_->run_offsets[index_]; }
+inline const char* TermRun::end() const { return terminals_->text.data() + terminals_->run_offsets[index_ + 1]; }
+inline char TermRun::color() const { return terminals_->run_colors[index_]; }
+inline bool TermRun::bold() const { return terminals_->run_faces[index_] & marathon::FontChange::kBold; }
+inline bool TermRun::italic() const { return terminals_->run_faces[index_] & marathon::FontChange::kItalic; }
+inline bool TermRun::underline() const { return terminals_->run_faces[index_] & marathon::FontChange::kUnderline; }
+
+inline int16 TermPage::type() const { return terminals_->page_types[index_]; }
+inline int TermPage::permutation() const { return terminals_->page_permutations[index_]; }
+inline int TermPage::flags() const { return terminals_->page_flags[index_]; }
+inline TermRange<TermRun> TermPage::runs() const { return TermRange<TermRun>(*terminals_, terminals_->page_first_runs[index_], terminals_->page_end_runs[index_]); }
+
+// a picture that is decoded, or found in PICTCache, when asked for;
+// holds only a handle to the resource bytes
+class LazyPICT {
+public:
+	LazyPICT() : raw_(false) { }
+	LazyPICT(bool raw, const marathon::ChunkData& data, const marathon::ChunkData& clut) : raw_(raw), data_(data), clut_(clut) { }
+
+	// null if the picture can't be decoded
+	std::shared_ptr<PICTResource> get() const { return PICTCache::Shared().Load(raw_, data_, clut_); }
+
+private:
+	bool raw_;
+	marathon::ChunkData data_;
+	marathon::ChunkData clut_;
 };
 struct Resources {
-	std::unordered_map<unsigned short, std::shared_ptr<atque::PICTResource>> picts;
-	std::unordered_map<unsigned short, std::string> texts;
-	std::vector<Levels> levels;
+	std::unordered_map<unsigned short, LazyPICT> picts;
+	std::unordered_map<unsigned short, marathon::ChunkData> texts; // read when first viewed
+	marathon::TextConverter converter; // the scenario's encoding, for texts
+
+	// level i is level_nums[i], and so on; its terminals are empty
+	// until it's decoded
+	std::vector<int> level_nums;
+	std::vector<std::string> level_names;
+	std::vector<LevelTerminals> level_terminals;
 };
 	class split_error : public std::runtime_error
 	{
@@ -58,7 +175,41 @@ struct Resources {
 		split_error(const std::string& what) : std::runtime_error(what) { }
 	};
 
-void split( Resources& rsrc, const std::string& source, const std::string& destination, std::ostream& log);
+	class split_cancelled : public split_error
+	{
+	public:
+		split_cancelled() : split_error("cancelled") { }
+	};
+
+// how far a split has got; bytes are those of the levels' terminal
+// chunks, which is what decoding a level reads
+struct SplitCounts {
+	std::size_t levels_done;
+	std::size_t levels;
+	std::size_t bytes_done;
+	std::size_t bytes;
+};
+
+// split reports to this as it works; the calls come from worker
+// threads, but never more than one at a time
+class SplitProgress {
+public:
+	virtual ~SplitProgress() { }
+
+	// rsrc has its pictures, texts and level names, but no pages yet;
+	// split is done with the pictures and texts, so they may be moved out
+	virtual void Started(Resources&) { }
+
+	// rsrc.level_terminals[index] is filled in, and split is done with
+	// it, so it may be moved out; its line has already been written to
+	// the log. Returning false cancels the split
+	virtual bool LevelDone(Resources&, std::size_t, const SplitCounts&) { return true; }
+};
+
+// levels and resources are decoded on up to jobs threads (all cores if
+// jobs <= 0); the results do not depend on the number of threads, but
+// the order of the per-level lines written to log does
+void split( Resources& rsrc, const std::string& source, std::ostream& log, int jobs = 0, SplitProgress* progress = nullptr);
 };
 
 #endif
@@ -0,0 +1,696 @@
+/* termrender.cpp
+
+   Copyright (C) 2008 by Gregory Smith
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   This license is contained in the file "COPYING", which is included
+   with this source code; it is available online at
+   http://www.gnu.org/licenses/gpl.html
+
+*/
+
+#include "termrender.h"
+#include "filesystem.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string.h>
+#include <zlib.h>
+
+using namespace atque;
+
+namespace
+{
+	// 5x9 glyphs for ' ' to '~', one byte per row with the leftmost
+	// pixel in bit 4; rows 7 and 8 are below the baseline
+	const uint8 font[95][9] = {
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+	{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00 }, // !
+	{ 0x0a, 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // "
+	{ 0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a, 0x00, 0x00 }, // #
+	{ 0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04, 0x00, 0x00 }, // $
+	{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03, 0x00, 0x00 }, // %
+	{ 0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d, 0x00, 0x00 }, // &
+	{ 0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // quote
+	{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02, 0x00, 0x00 }, // (
+	{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08, 0x00, 0x00 }, // )
+	{ 0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00, 0x00, 0x00 }, // *
+	{ 0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00, 0x00, 0x00 }, // +
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c, 0x04, 0x08 }, // ,
+	{ 0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00, 0x00, 0x00 }, // -
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c, 0x00, 0x00 }, // .
+	{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00, 0x00, 0x00 }, // /
+	{ 0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e, 0x00, 0x00 }, // 0
+	{ 0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e, 0x00, 0x00 }, // 1
+	{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f, 0x00, 0x00 }, // 2
+	{ 0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e, 0x00, 0x00 }, // 3
+	{ 0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02, 0x00, 0x00 }, // 4
+	{ 0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e, 0x00, 0x00 }, // 5
+	{ 0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e, 0x00, 0x00 }, // 6
+	{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08, 0x00, 0x00 }, // 7
+	{ 0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e, 0x00, 0x00 }, // 8
+	{ 0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c, 0x00, 0x00 }, // 9
+	{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00, 0x00, 0x00 }, // :
+	{ 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x04, 0x08, 0x00 }, // ;
+	{ 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02, 0x00, 0x00 }, // <
+	{ 0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00, 0x00, 0x00 }, // =
+	{ 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08, 0x00, 0x00 }, // >
+	{ 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04, 0x00, 0x00 }, // ?
+	{ 0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e, 0x00, 0x00 }, // @
+	{ 0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11, 0x00, 0x00 }, // A
+	{ 0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e, 0x00, 0x00 }, // B
+	{ 0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e, 0x00, 0x00 }, // C
+	{ 0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c, 0x00, 0x00 }, // D
+	{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f, 0x00, 0x00 }, // E
+	{ 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10, 0x00, 0x00 }, // F
+	{ 0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f, 0x00, 0x00 }, // G
+	{ 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11, 0x00, 0x00 }, // H
+	{ 0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e, 0x00, 0x00 }, // I
+	{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c, 0x00, 0x00 }, // J
+	{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11, 0x00, 0x00 }, // K
+	{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f, 0x00, 0x00 }, // L
+	{ 0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11, 0x00, 0x00 }, // M
+	{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11, 0x00, 0x00 }, // N
+	{ 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e, 0x00, 0x00 }, // O
+	{ 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10, 0x00, 0x00 }, // P
+	{ 0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d, 0x00, 0x00 }, // Q
+	{ 0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11, 0x00, 0x00 }, // R
+	{ 0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e, 0x00, 0x00 }, // S
+	{ 0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x00 }, // T
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e, 0x00, 0x00 }, // U
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04, 0x00, 0x00 }, // V
+	{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a, 0x00, 0x00 }, // W
+	{ 0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11, 0x00, 0x00 }, // X
+	{ 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x04, 0x00, 0x00 }, // Y
+	{ 0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f, 0x00, 0x00 }, // Z
+	{ 0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e, 0x00, 0x00 }, // [
+	{ 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00, 0x00, 0x00 }, // backslash
+	{ 0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e, 0x00, 0x00 }, // ]
+	{ 0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // ^
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f, 0x00 }, // _
+	{ 0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // `
+	{ 0x00, 0x00, 0x0e, 0x01, 0x0f, 0x11, 0x0f, 0x00, 0x00 }, // a
+	{ 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1e, 0x00, 0x00 }, // b
+	{ 0x00, 0x00, 0x0e, 0x10, 0x10, 0x11, 0x0e, 0x00, 0x00 }, // c
+	{ 0x01, 0x01, 0x0d, 0x13, 0x11, 0x11, 0x0f, 0x00, 0x00 }, // d
+	{ 0x00, 0x00, 0x0e, 0x11, 0x1f, 0x10, 0x0e, 0x00, 0x00 }, // e
+	{ 0x06, 0x09, 0x08, 0x1c, 0x08, 0x08, 0x08, 0x00, 0x00 }, // f
+	{ 0x00, 0x00, 0x0f, 0x11, 0x11, 0x0f, 0x01, 0x11, 0x0e }, // g
+	{ 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11, 0x00, 0x00 }, // h
+	{ 0x04, 0x00, 0x0c, 0x04, 0x04, 0x04, 0x0e, 0x00, 0x00 }, // i
+	{ 0x02, 0x00, 0x06, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c }, // j
+	{ 0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12, 0x00, 0x00 }, // k
+	{ 0x0c, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e, 0x00, 0x00 }, // l
+	{ 0x00, 0x00, 0x1a, 0x15, 0x15, 0x11, 0x11, 0x00, 0x00 }, // m
+	{ 0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11, 0x00, 0x00 }, // n
+	{ 0x00, 0x00, 0x0e, 0x11, 0x11, 0x11, 0x0e, 0x00, 0x00 }, // o
+	{ 0x00, 0x00, 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10 }, // p
+	{ 0x00, 0x00, 0x0f, 0x11, 0x11, 0x0f, 0x01, 0x01, 0x01 }, // q
+	{ 0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10, 0x00, 0x00 }, // r
+	{ 0x00, 0x00, 0x0e, 0x10, 0x0e, 0x01, 0x1e, 0x00, 0x00 }, // s
+	{ 0x08, 0x08, 0x1c, 0x08, 0x08, 0x09, 0x06, 0x00, 0x00 }, // t
+	{ 0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0d, 0x00, 0x00 }, // u
+	{ 0x00, 0x00, 0x11, 0x11, 0x11, 0x0a, 0x04, 0x00, 0x00 }, // v
+	{ 0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0a, 0x00, 0x00 }, // w
+	{ 0x00, 0x00, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x00, 0x00 }, // x
+	{ 0x00, 0x00, 0x11, 0x11, 0x11, 0x0f, 0x01, 0x11, 0x0e }, // y
+	{ 0x00, 0x00, 0x1f, 0x02, 0x04, 0x08, 0x1f, 0x00, 0x00 }, // z
+	{ 0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02, 0x00, 0x00 }, // {
+	{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x00 }, // |
+	{ 0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08, 0x00, 0x00 }, // }
+	{ 0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00, 0x00, 0x00 }, // ~
+	};
+
+	// glyphs sit this far down their cell
+	const int kGlyphTop = 2;
+
+	const uint8 termColor[8][3] = {
+		{ 0, 255, 0 },
+		{ 255, 255, 255 },
+		{ 255, 0, 0 },
+		{ 0, 153, 0 },
+		{ 0, 255, 255 },
+		{ 255, 255, 0 },
+		{ 153, 0, 0 },
+		{ 0, 0, 255 },
+	};
+
+	const uint8 rubiconTermColor[8][3] = {
+		{ 0, 255, 0 },
+		{ 255, 255, 255 },
+		{ 255, 0, 0 },
+		{ 0, 153, 0 },
+		{ 204, 204, 255 },
+		{ 204, 204, 204 },
+		{ 153, 0, 0 },
+		{ 153, 153, 204 },
+	};
+
+	// Latin-1 letters without their accents, from U+00C0
+	const char unaccented[] = "AAAAAAACEEEEIIIIDNOOOOOxOUUUUYPsaaaaaaaceeeeiiiidnooooo/ouuuuypy";
+
+	// the glyph to draw for a code point; '?' if there isn't one
+	uint8 GlyphFor(uint32 c)
+	{
+		if (c >= ' ' && c <= '~')
+			return c - ' ';
+		if (c >= 0xc0 && c <= 0xff)
+			return unaccented[c - 0xc0] - ' ';
+
+		switch (c)
+		{
+		case 0xa0:
+			return 0;
+		case 0x2018:
+		case 0x2019:
+			return '\'' - ' ';
+		case 0x201c:
+		case 0x201d:
+			return '"' - ' ';
+		case 0x2013:
+		case 0x2014:
+			return '-' - ' ';
+		case 0x2022:
+			return '*' - ' ';
+		case 0x2026:
+			return '.' - ' ';
+		}
+
+		return '?' - ' ';
+	}
+
+	// decodes one UTF-8 sequence at p, moving p past it
+	uint32 NextCodePoint(const char*& p, const char* end)
+	{
+		uint8 c = *p++;
+		int extra = (c >= 0xf0) ? 3 : (c >= 0xe0) ? 2 : (c >= 0xc0) ? 1 : 0;
+		uint32 code = (extra == 0) ? c : c & (0x3f >> extra);
+		for (; extra > 0 && p != end && (*p & 0xc0) == 0x80; --extra)
+			code = (code << 6) | (*p++ & 0x3f);
+
+		return code;
+	}
+
+	void SetPixel(TermImage& image, int x, int y, const uint8* color)
+	{
+		if (x >= 0 && x < image.width && y >= 0 && y < image.height)
+			memcpy(image.row(y) + x * 3, color, 3);
+	}
+
+	// adds black rows to the bottom of image
+	void Grow(TermImage& image, int height)
+	{
+		if (height > image.height)
+		{
+			image.pixels.resize(image.width * height * 3);
+			image.height = height;
+		}
+	}
+
+	void DrawGlyph(TermImage& image, uint8 glyph, uint8 style, int x, int y, const uint8* color)
+	{
+		for (int row = 0; row < 9; ++row)
+		{
+			uint8 bits = font[glyph][row];
+			if (!bits)
+				continue;
+
+			// lean the part above the baseline to the right
+			int shift = (style & TermString::kItalic) ? std::max(0, (6 - row) / 3) : 0;
+			for (int col = 0; col < 5; ++col)
+			{
+				if (bits & (0x10 >> col))
+				{
+					SetPixel(image, x + col + shift, y + kGlyphTop + row, color);
+					if (style & TermString::kBold)
+						SetPixel(image, x + col + shift + 1, y + kGlyphTop + row, color);
+				}
+			}
+		}
+
+		if (style & TermString::kUnderline)
+		{
+			for (int col = 0; col < TermRenderer::kCharWidth; ++col)
+				SetPixel(image, x + col, y + kGlyphTop + 7, color);
+		}
+	}
+}
+
+namespace
+{
+	void PutBE(std::vector<uint8>& out, uint32 value)
+	{
+		out.push_back(value >> 24);
+		out.push_back(value >> 16);
+		out.push_back(value >> 8);
+		out.push_back(value);
+	}
+
+	void PutChunk(std::vector<uint8>& out, const char* type, const std::vector<uint8>& data)
+	{
+		PutBE(out, data.size());
+		std::size_t start = out.size();
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), data.begin(), data.end());
+		PutBE(out, crc32(0, &out[start], out.size() - start));
+	}
+
+	// level folders are named the way merge expects
+	std::string LevelFolder(int num, const std::string& level_name)
+	{
+		char prefix[16];
+		snprintf(prefix, sizeof(prefix), "%02d ", num);
+		std::string name = prefix + level_name;
+		for (std::string::iterator it = name.begin(); it != name.end(); ++it)
+		{
+			if (*it == '/' || *it == '\\' || *it == ':')
+				*it = '-';
+		}
+
+		return name;
+	}
+}
+
+// every row uses the Sub filter, which suits the long runs of one
+// colour terminal pages have
+bool TermImage::ExportPNG(const std::string& path) const
+{
+	std::vector<uint8> filtered;
+	filtered.reserve(height * (width * 3 + 1));
+	for (int y = 0; y < height; ++y)
+	{
+		const uint8* src = row(y);
+		filtered.push_back(1);
+		filtered.insert(filtered.end(), src, src + 3);
+		for (int x = 3; x < width * 3; ++x)
+			filtered.push_back(src[x] - src[x - 3]);
+	}
+
+	uLongf length = compressBound(filtered.size());
+	std::vector<uint8> compressed(length);
+	if (compress2(compressed.data(), &length, filtered.data(), filtered.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+		return false;
+	compressed.resize(length);
+
+	std::vector<uint8> header;
+	PutBE(header, width);
+	PutBE(header, height);
+	header.push_back(8); // bits per channel
+	header.push_back(2); // RGB
+	header.push_back(0);
+	header.push_back(0);
+	header.push_back(0);
+
+	static const uint8 signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	std::vector<uint8> png(signature, signature + sizeof(signature));
+	PutChunk(png, "IHDR", header);
+	PutChunk(png, "IDAT", compressed);
+	PutChunk(png, "IEND", std::vector<uint8>());
+
+	std::ofstream stream(path.c_str(), std::ios::out | std::ios::binary);
+	stream.write(reinterpret_cast<const char*>(png.data()), png.size());
+	return stream.good();
+}
+
+// one code point of text being laid out
+struct TermRenderer::Glyph
+{
+	const char* begin;
+	const char* end;
+	int width;
+	uint8 color;
+	uint8 style;
+	bool builtin;
+};
+
+int TermRenderer::Advance(uint32, uint8) const
+{
+	// the built-in font draws everything, if only as '?'
+	return kCharWidth;
+}
+
+int TermRenderer::LineHeight() const
+{
+	return kLineHeight;
+}
+
+const uint8* TermRenderer::Color(int index) const
+{
+	return (rubicon_ ? rubiconTermColor : termColor)[index & 7];
+}
+
+void TermRenderer::DrawBuiltin(TermImage& image, const TermString& string) const
+{
+	const uint8* color = Color(string.color);
+	const char* p = string.text.data();
+	const char* end = p + string.text.size();
+	for (int x = string.x; p != end; x += kCharWidth)
+		DrawGlyph(image, GlyphFor(NextCodePoint(p, end)), string.style, x, string.y, color);
+}
+
+void TermRenderer::DrawStrings(TermImage& image, const std::vector<TermString>& strings) const
+{
+	for (std::vector<TermString>::const_iterator it = strings.begin(); it != strings.end(); ++it)
+		DrawBuiltin(image, *it);
+}
+
+// appends the code points from begin to end, with their widths in the
+// renderer's font, or the built-in font's where it has none
+void TermRenderer::Measure(std::vector<Glyph>& glyphs, const char* begin, const char* end, uint8 color, uint8 style) const
+{
+	const char* p = begin;
+	while (p != end)
+	{
+		Glyph glyph = { p, 0, 0, color, style, false };
+		uint32 c = NextCodePoint(p, end);
+		glyph.end = p;
+		glyph.width = Advance(c, style);
+		if (glyph.width <= 0)
+		{
+			glyph.width = kCharWidth;
+			glyph.builtin = true;
+		}
+		glyphs.push_back(glyph);
+	}
+}
+
+// glyphs from begin to end as one line starting at x, y, with a string
+// for each change of color, style or font
+void TermRenderer::Place(std::vector<TermString>& strings, const std::vector<Glyph>& glyphs, std::size_t begin, std::size_t end, int x, int y)
+{
+	for (std::size_t i = begin; i < end; ++i)
+	{
+		const Glyph& glyph = glyphs[i];
+		if (i == begin || glyph.color != strings.back().color || glyph.style != strings.back().style || glyph.builtin != strings.back().builtin)
+		{
+			TermString string = { x, y, glyph.color, glyph.style, glyph.builtin, std::string() };
+			strings.push_back(string);
+		}
+		strings.back().text.append(glyph.begin, glyph.end);
+		x += glyph.width;
+	}
+}
+
+int TermRenderer::LayOutText(std::vector<TermString>& strings, TermImage& image, const TermPage& page, int x, int y, int width, bool center) const
+{
+	// split the runs into paragraphs of glyphs
+	std::vector<std::vector<Glyph>> paragraphs(1);
+	TermRange<TermRun> runs = page.runs();
+	for (TermRange<TermRun>::iterator it = runs.begin(); it != runs.end(); ++it)
+	{
+		TermRun run = *it;
+		uint8 style = (run.bold() ? TermString::kBold : 0) | (run.italic() ? TermString::kItalic : 0) | (run.underline() ? TermString::kUnderline : 0);
+
+		const char* end = run.end();
+		const char* p = run.begin();
+		while (p != end)
+		{
+			const char* line_end = std::find(p, end, '\n');
+			Measure(paragraphs.back(), p, line_end, run.color() & 7, style);
+			if (line_end == end)
+				break;
+
+			paragraphs.push_back(std::vector<Glyph>());
+			p = line_end + 1;
+		}
+
+	}
+
+	const int line_height = LineHeight();
+	for (std::vector<std::vector<Glyph>>::const_iterator paragraph = paragraphs.begin(); paragraph != paragraphs.end(); ++paragraph)
+	{
+		// wrap at the last space that fits, or mid-word if none does
+		std::size_t start = 0;
+		do
+		{
+			std::size_t end = start;
+			int line_width = 0;
+			while (end < paragraph->size() && line_width + (*paragraph)[end].width <= width)
+				line_width += (*paragraph)[end++].width;
+
+			std::size_t next = end;
+			if (end < paragraph->size())
+			{
+				std::size_t space = end;
+				while (space > start && *(*paragraph)[space].begin != ' ')
+					--space;
+				if (space > start)
+				{
+					end = space;
+					next = space + 1;
+				}
+				else if (end == start)
+				{
+					// a glyph wider than the line gets it to itself
+					end = next = start + 1;
+				}
+
+				line_width = 0;
+				for (std::size_t i = start; i < end; ++i)
+					line_width += (*paragraph)[i].width;
+			}
+
+			Grow(image, y + line_height);
+			int left = x;
+			if (center)
+				left += (width - line_width) / 2;
+			Place(strings, *paragraph, start, end, left, y);
+
+			y += line_height;
+			start = next;
+		}
+		while (start < paragraph->size());
+	}
+
+	return y;
+}
+
+void TermRenderer::LayOutLabel(std::vector<TermString>& strings, const std::string& label, int x, int y) const
+{
+	std::vector<Glyph> glyphs;
+	Measure(glyphs, label.data(), label.data() + label.size(), 0, 0);
+	Place(strings, glyphs, 0, glyphs.size(), x, y);
+}
+
+TermImage TermRenderer::Picture(const PICTResource& pict) const
+{
+	TermImage picture;
+	if (!pict.IsJPEG())
+	{
+		picture.width = pict.Width();
+		picture.height = pict.Height();
+		picture.pixels = pict.Pixels();
+	}
+
+	return picture;
+}
+
+TermImage TermRenderer::FindPicture(int id, int max_width, int max_height) const
+{
+	std::unordered_map<unsigned short, LazyPICT>::const_iterator it = rsrc_.picts.find(id);
+	if (it == rsrc_.picts.end())
+		return TermImage();
+
+	std::shared_ptr<PICTResource> pict = it->second.get();
+	if (!pict)
+		return TermImage();
+
+	TermImage picture = Picture(*pict);
+	if (picture.empty() || !max_width || (picture.width <= max_width && picture.height <= max_height))
+		return picture;
+
+	// nearest neighbour, as wxImage::Rescale does by default
+	double scale = std::max(picture.width / static_cast<double>(max_width), picture.height / static_cast<double>(max_height));
+	TermImage scaled(std::max(1, static_cast<int>(picture.width / scale)), std::max(1, static_cast<int>(picture.height / scale)));
+	for (int y = 0; y < scaled.height; ++y)
+	{
+		const uint8* src = picture.row(y * picture.height / scaled.height);
+		uint8* dst = scaled.row(y);
+		for (int x = 0; x < scaled.width; ++x)
+			memcpy(dst + x * 3, src + (x * picture.width / scaled.width) * 3, 3);
+	}
+
+	return scaled;
+}
+
+void TermRenderer::DrawPicture(TermImage& image, const TermImage& picture, int x, int y) const
+{
+	int left = std::max(0, -x);
+	int right = std::min(picture.width, image.width - x);
+	if (right <= left)
+		return;
+
+	Grow(image, y + picture.height);
+	for (int row = std::max(0, -y); row < picture.height; ++row)
+		memcpy(image.row(y + row) + (x + left) * 3, picture.row(row) + left * 3, (right - left) * 3);
+}
+
+TermImage TermRenderer::Layout(const TermPage& page, std::vector<TermString>& strings) const
+{
+	TermImage image(kWidth, kHeight);
+	char buf[128];
+	int bottom = 0;
+
+	switch (page.type())
+	{
+	case marathon::TerminalGrouping::kLogon:
+	case marathon::TerminalGrouping::kLogoff:
+	{
+		TermImage picture = FindPicture(page.permutation());
+		int y = 32;
+		if (!picture.empty())
+		{
+			DrawPicture(image, picture, 320 - picture.width / 2, 27);
+			y = 27 + picture.height;
+		}
+		else
+		{
+			snprintf(buf, sizeof(buf), "#LOGON/LOGOFF %d", page.permutation());
+			LayOutLabel(strings, buf, 0, 60);
+		}
+		bottom = LayOutText(strings, image, page, 0, y, 640, true);
+		break;
+	}
+	case marathon::TerminalGrouping::kPict:
+	{
+		snprintf(buf, sizeof(buf), "#PICT %d", page.permutation());
+		if (page.flags() & marathon::TerminalGrouping::kCenterObject)
+		{
+			TermImage picture = FindPicture(page.permutation());
+			if (!picture.empty())
+				DrawPicture(image, picture, 52, 27);
+			else
+				LayOutLabel(strings, buf, 52, 27);
+		}
+		else
+		{
+			// the picture is centered in its half, the text goes in
+			// the other
+			bool right = page.flags() & marathon::TerminalGrouping::kDrawObjectOnRight;
+			int picture_x = right ? 324 : 9;
+			TermImage picture = FindPicture(page.permutation(), 306, 266);
+			if (!picture.empty())
+				DrawPicture(image, picture, picture_x + (306 - picture.width) / 2, 27 + (266 - picture.height) / 2);
+			else
+				LayOutLabel(strings, buf, picture_x, 27);
+			bottom = LayOutText(strings, image, page, right ? 9 : 324, 27, 307, false);
+		}
+		break;
+	}
+	case marathon::TerminalGrouping::kCheckpoint:
+		snprintf(buf, sizeof(buf), "CHECKPOINT #%d", page.permutation());
+		if (page.flags() & marathon::TerminalGrouping::kCenterObject)
+		{
+			LayOutLabel(strings, buf, 27, 27);
+		}
+		else if (page.flags() & marathon::TerminalGrouping::kDrawObjectOnRight)
+		{
+			bottom = LayOutText(strings, image, page, 9, 27, 307, false);
+			LayOutLabel(strings, buf, 324, 27);
+		}
+		else
+		{
+			LayOutLabel(strings, buf, 9, 27);
+			bottom = LayOutText(strings, image, page, 324, 27, 307, false);
+		}
+		break;
+	case marathon::TerminalGrouping::kInformation:
+		bottom = LayOutText(strings, image, page, 27, 27, 614, false);
+		break;
+	case marathon::TerminalGrouping::kSound:
+		bottom = LayOutText(strings, image, page, 27, 47, 614, false);
+		break;
+	case marathon::TerminalGrouping::kIntralevelTeleport:
+		snprintf(buf, sizeof(buf), "TELEPORT TO polygon %d", page.permutation());
+		LayOutLabel(strings, buf, 27, 27);
+		break;
+	case marathon::TerminalGrouping::kInterlevelTeleport:
+		if (page.permutation() >= 0 && page.permutation() < static_cast<int>(rsrc_.level_names.size()))
+			LayOutLabel(strings, "TELEPORT TO " + rsrc_.level_names[page.permutation()], 27, 27);
+		else
+			LayOutLabel(strings, "TELEPORT TO level " + std::to_string(page.permutation()), 27, 27);
+		break;
+	case marathon::TerminalGrouping::kStatic:
+		snprintf(buf, sizeof(buf), "STATIC EFFECT in %d", page.permutation());
+		LayOutLabel(strings, buf, 27, 27);
+		break;
+	case marathon::TerminalGrouping::kTag:
+		snprintf(buf, sizeof(buf), "TAG %d", page.permutation());
+		LayOutLabel(strings, buf, 27, 27);
+		break;
+	}
+
+	// leave the same margin below overflowing text as above it
+	if (bottom > kHeight - 27)
+		Grow(image, bottom + 27);
+
+	return image;
+}
+
+TermImage TermRenderer::Render(const TermPage& page) const
+{
+	std::vector<TermString> strings;
+	TermImage image = Layout(page, strings);
+	DrawStrings(image, strings);
+	return image;
+}
+
+void atque::render_terminals(const Resources& rsrc, const TermRenderer& renderer, const std::string& dest, std::ostream& log, int jobs)
+{
+	static const char* groups[] = { "unfinished", "finished", "failure" };
+
+	if (!fs::is_directory(dest) && !fs::create_directory(dest))
+	{
+		throw render_error("could not create " + dest);
+	}
+
+	// folders are made up front; the pages can then be written in any
+	// order
+	std::vector<std::pair<TermPage, std::string> > pages;
+	for (std::size_t level = 0; level < rsrc.level_terminals.size(); ++level)
+	{
+		const LevelTerminals& terminals = rsrc.level_terminals[level];
+		if (!terminals.terminal_count())
+			continue;
+
+		fs::path folder = fs::path(dest) / LevelFolder(rsrc.level_nums[level], rsrc.level_names[level]);
+		if (!folder.is_directory() && !folder.create_directory())
+		{
+			throw render_error("could not create " + folder.string());
+		}
+
+		for (std::size_t terminal = 0; terminal < terminals.terminal_count(); ++terminal)
+		{
+			for (int group = 0; group < 3; ++group)
+			{
+				TermGroup group_pages = terminals.group(terminal, group);
+				for (std::size_t page = 0; page < group_pages.size(); ++page)
+				{
+					char name[64];
+					snprintf(name, sizeof(name), "%02d-%s-%02d.png", static_cast<int>(terminal), groups[group], static_cast<int>(page));
+					pages.push_back(std::make_pair(group_pages[page], (folder / name).string()));
+				}
+			}
+		}
+	}
+
+	parallel_for(pages.size(), jobs, [&](std::size_t i) {
+		if (!renderer.Render(pages[i].first).ExportPNG(pages[i].second))
+		{
+			throw render_error("error writing " + pages[i].second);
+		}
+	});
+
+	log << "rendered " << pages.size() << " terminal pages" << std::endl;
+}
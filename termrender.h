@@ -0,0 +1,142 @@
+/* termrender.h
+
+   Copyright (C) 2008 by Gregory Smith
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   This license is contained in the file "COPYING", which is included
+   with this source code; it is available online at
+   http://www.gnu.org/licenses/gpl.html
+
+*/
+
+/*
+  Draws terminal pages into plain RGB images; needs no GUI toolkit.
+  Text is drawn in a built-in fixed-width font unless a subclass
+  supplies a real one
+*/
+
+#ifndef TERMRENDER_H
+#define TERMRENDER_H
+
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "split.h"
+
+namespace atque
+{
+	// rows of RGB triples, top to bottom
+	struct TermImage
+	{
+		int width;
+		int height;
+		std::vector<uint8> pixels;
+
+		TermImage() : width(0), height(0) { }
+		TermImage(int width, int height) : width(width), height(height), pixels(width * height * 3) { }
+
+		bool empty() const { return pixels.empty(); }
+		uint8* row(int y) { return &pixels[y * width * 3]; }
+		const uint8* row(int y) const { return &pixels[y * width * 3]; }
+
+		bool ExportPNG(const std::string& path) const;
+	};
+
+	// laid out text in one color and style
+	struct TermString
+	{
+		enum {
+			kBold = 1,
+			kItalic = 2,
+			kUnderline = 4
+		};
+
+		int x;
+		int y;
+		uint8 color;
+		uint8 style;
+
+		// for glyphs the renderer's font doesn't have
+		bool builtin;
+
+		std::string text;
+	};
+
+	class TermRenderer
+	{
+	public:
+		enum {
+			kWidth = 660,
+			kHeight = 320,
+			kCharWidth = 6,
+			kLineHeight = 12
+		};
+
+		TermRenderer(const Resources& rsrc, bool rubicon = false) : rsrc_(rsrc), rubicon_(rubicon) { }
+		virtual ~TermRenderer() { }
+
+		// the page as TerminalViewPanel shows it; at least kWidth x
+		// kHeight, and taller if the text runs past the bottom
+		TermImage Render(const TermPage& page) const;
+
+	protected:
+		// draws the page's pictures and lays out its text, which is
+		// left for DrawStrings
+		TermImage Layout(const TermPage& page, std::vector<TermString>& strings) const;
+
+		// JPEG pictures come back empty unless a subclass can decode them
+		virtual TermImage Picture(const PICTResource& pict) const;
+
+		// the font: a code point's width, or 0 if the font has no glyph
+		// for it and the built-in one should draw it instead
+		virtual int Advance(uint32 code, uint8 style) const;
+		virtual int LineHeight() const;
+		virtual void DrawStrings(TermImage& image, const std::vector<TermString>& strings) const;
+
+		// draws string in the built-in font
+		void DrawBuiltin(TermImage& image, const TermString& string) const;
+		const uint8* Color(int index) const;
+
+	private:
+		const Resources& rsrc_;
+		bool rubicon_;
+
+		struct Glyph;
+		void Measure(std::vector<Glyph>& glyphs, const char* begin, const char* end, uint8 color, uint8 style) const;
+		static void Place(std::vector<TermString>& strings, const std::vector<Glyph>& glyphs, std::size_t begin, std::size_t end, int x, int y);
+
+		// returns the y just below the last line
+		int LayOutText(std::vector<TermString>& strings, TermImage& image, const TermPage& page, int x, int y, int width, bool center) const;
+		void LayOutLabel(std::vector<TermString>& strings, const std::string& label, int x, int y) const;
+
+		void DrawPicture(TermImage& image, const TermImage& picture, int x, int y) const;
+
+		// picture id, scaled down to fit in max_width x max_height if
+		// those are given; empty if there is no such picture
+		TermImage FindPicture(int id, int max_width = 0, int max_height = 0) const;
+	};
+
+	class render_error : public std::runtime_error
+	{
+	public:
+		render_error(const std::string& what) : std::runtime_error(what) { }
+	};
+
+	// writes every page of every level to
+	// dest/<level> <name>/<terminal>-<group>-<page>.png, drawn by
+	// renderer on up to jobs threads (all cores if jobs <= 0), so it
+	// can't be one that draws with a GUI toolkit
+	void render_terminals(const Resources& rsrc, const TermRenderer& renderer, const std::string& dest, std::ostream& log, int jobs = 0);
+}
+
+#endif
@@ -2,60 +2,11 @@
 #include "termview.h"
 #include "split.h"
 #include "merge.h"
+#include "wxtermrender.h"
 #include <iostream>
 #include <sstream>
 #include <vector>
 #include <wx/wx.h>
-#include <wx/richtext/richtextbuffer.h>
-#include <wx/richtext/richtextctrl.h>
-
-class wxImagePanel : public wxPanel
-{
-	wxBitmap image;
-    
-public:
-	wxImagePanel(wxWindow* parent, const wxBitmap& bmp,
-				 wxWindowID id=wxID_ANY, const wxPoint &pos=wxDefaultPosition);
-    
-	void paintEvent(wxPaintEvent & evt);
-	void paintNow();
-    
-	void render(wxDC& dc);
-        
-	DECLARE_EVENT_TABLE()
-};
-
-
-BEGIN_EVENT_TABLE(wxImagePanel, wxPanel)
-
-// catch paint events
-EVT_PAINT(wxImagePanel::paintEvent)
-
-END_EVENT_TABLE()
-
-
-wxImagePanel::wxImagePanel(wxWindow* parent, const wxBitmap& img,  wxWindowID id, const wxPoint &pos)
-:wxPanel(parent, id, pos, wxSize(img.GetWidth(), img.GetHeight())), image(img)
-{}
-
-void wxImagePanel::paintEvent(wxPaintEvent & evt)
-{
-    wxPaintDC dc(this);
-    render(dc);
-}
-
-void wxImagePanel::paintNow()
-{
-    wxClientDC dc(this);
-    render(dc);
-}
-
-void wxImagePanel::render(wxDC&  dc)
-{
-    dc.DrawBitmap( image, 0, 0, false );
-}
-
-
 
 LevelSelector::	LevelSelector(wxWindow* parent, atque::Resources* rsrc, const std::vector<wxString>& levels)
 	:wxChoice( parent, 1, wxDefaultPosition, wxDefaultSize,
@@ -64,24 +15,24 @@ LevelSelector::	LevelSelector(wxWindow* parent, atque::Resources* rsrc, const st
 {
 }
 
-const atque::Levels* LevelSelector::selected() {
+const atque::LevelTerminals* LevelSelector::selected() {
 	int levelId = GetSelection();
 	if( levelId == wxNOT_FOUND ) {
 		return nullptr;
 	}
-	return &rsrc->levels.at( levelId );
+	return &rsrc->level_terminals.at( levelId );
 }
 TerminalGroupSelector::TerminalGroupSelector(wxWindow* parent)
 	:wxSpinCtrl( parent, 100 ) {
 }
 
-const std::array<std::vector<atque::TermPage>, 3>* TerminalGroupSelector::selected() {
+int TerminalGroupSelector::selected() {
 	TermView* parent = static_cast<TermView*>(GetParent());
 	auto p = parent->ls->selected();
-	if( ! p || GetValue() >= p->pages.size() ) {
-		return nullptr;
+	if( ! p || GetValue() >= p->terminal_count() ) {
+		return -1;
 	}
-	return  &p->pages[ GetValue() ];	
+	return GetValue();
 }
 
 
@@ -96,37 +47,37 @@ void TerminalGroupSelector::update(int max) {
 }
 void TerminalGroupSelector::OnSelect(wxSpinEvent &event) {
 	TermView* parent = static_cast<TermView*>(GetParent());
-	auto p = selected();
-	if( p ) {
-		parent->termGrpRadio->update(*p);
+	int terminal = selected();
+	if( terminal != -1 ) {
+		parent->termGrpRadio->update(*parent->ls->selected(), terminal);
 	}
 	parent->tPanel->update();
 }
 
-void TerminalGrpRadio::update(const std::array<std::vector<atque::TermPage>, 3>& gp) {
+void TerminalGrpRadio::update(const atque::LevelTerminals& terminals, int terminal) {
 	TermView* parent = static_cast<TermView*>(GetParent());
-	Enable(0, ! gp[0].empty() );
-	Enable(1, ! gp[1].empty() );
-	Enable(2, ! gp[2].empty() );
-	int selected = gp[0].empty() ?
-		gp[1].empty() ?
-		gp[2].empty() ? -1 : 2
-		: 1
-		: 0;
+	int selected = -1;
+	for( int group = 2; group >= 0; --group ) {
+		bool empty = terminals.group( terminal, group ).empty();
+		Enable( group, ! empty );
+		if( ! empty ) {
+			selected = group;
+		}
+	}
 	if( selected != -1 ) {
 		SetSelection(selected);
-		parent->pageBar->SetMax( gp[selected].size() - 1 );
+		parent->pageBar->SetMax( terminals.group( terminal, selected ).size() - 1 );
 		parent->pageBar->SetValue( 0 );
 	}
 }
 void LevelSelector::OnSelect(wxCommandEvent &event) {
 	TermView* parent = static_cast<TermView*>(GetParent());
 	auto p = selected();
-	if( ! p || p->pages.empty() ) {
+	if( ! p || ! p->terminal_count() ) {
 		parent->itemSelector->update(-1);
 	} else {
-		parent->itemSelector->update( p->pages.size());
-		parent->termGrpRadio->update(p->pages[0]);
+		parent->itemSelector->update( p->terminal_count() );
+		parent->termGrpRadio->update( *p, 0 );
 	}
 	parent->tPanel->update();
 }
@@ -137,8 +88,11 @@ void  TerminalRubiconChkbox::onClick(wxCommandEvent &event) {
 }
 
 TerminalViewPanel::TerminalViewPanel(wxWindow* parent)
-	:wxPanel(parent, 2500, wxDefaultPosition, wxSize(660, 320)) {
+	:wxScrolledWindow(parent, 2500, wxDefaultPosition,
+					  wxSize(atque::TermRenderer::kWidth, atque::TermRenderer::kHeight), wxVSCROLL),
+	 shown(nullptr) {
 	SetBackgroundColour( *wxBLACK );
+	SetScrollRate( 0, atque::TermRenderer::kLineHeight );
 }
 
 static const wxString termGrpStr[] = { "UNFINISHED", "FINISHED", "FAILURE" };
@@ -146,13 +100,13 @@ TerminalGrpRadio::TerminalGrpRadio(wxWindow* parent)
 	:wxRadioBox( parent, 550, "Terminal Groups", wxDefaultPosition, wxDefaultSize, 3, termGrpStr,
 				 0, wxRA_SPECIFY_ROWS) {}
 
-TermView::TermView(atque::Resources* rsrc, const std::vector<wxString>& levels)
+TermView::TermView(std::shared_ptr<atque::Resources> rsrc, const std::vector<wxString>& levels)
 	:wxFrame(nullptr, wxID_ANY, "Terminal view" )
 	,rsrc(rsrc)
 {
 	wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
 	tPanel = new TerminalViewPanel(this);
-	ls = new LevelSelector(this, rsrc, levels);
+	ls = new LevelSelector(this, rsrc.get(), levels);
 	sizer->Add(ls, wxSizerFlags(0).Center());
 	wxSizer* sizer2 = new wxBoxSizer( wxHORIZONTAL );
 	sizer2->Add(new wxStaticText(this, 10001, "# TERMINAL:"), 1, wxALIGN_LEFT);
@@ -172,33 +126,40 @@ TermView::TermView(atque::Resources* rsrc, const std::vector<wxString>& levels)
 	SetSizerAndFit( sizer );
 }
 
-TermView::~TermView() {
-	delete rsrc;
+void TermView::levelDecoded(int index) {
+	// show the pages if the level was already picked
+	if( ls->GetSelection() == index ) {
+		wxCommandEvent event;
+		ls->OnSelect( event );
+	}
 }
 
-const std::vector<atque::TermPage>* TerminalGrpRadio::selected() {
+int TerminalGrpRadio::selected() {
 	TermView* parent = static_cast<TermView*>(GetParent());
-	auto p = parent->itemSelector->selected();
-	if( ! p || GetSelection() >= p->size() ) {
-		return nullptr;
+	if( parent->itemSelector->selected() == -1 || GetSelection() < 0 || GetSelection() >= 3 ) {
+		return -1;
 	}
-	return &(*p)[ GetSelection() ];
+	return GetSelection();
 }
 
-const atque::TermPage* TerminalPageSlider::selected() {
+int TerminalPageSlider::selected() {
 	TermView* parent = static_cast<TermView*>(GetParent());
-	auto tg_sel = parent->termGrpRadio->selected();
-	if( ! tg_sel ) {
-		return nullptr;
+	int group = parent->termGrpRadio->selected();
+	if( group == -1 ) {
+		return -1;
 	}
-	
-	return &(*tg_sel)[ GetValue() ];
+
+	auto pages = parent->ls->selected()->group( parent->itemSelector->selected(), group );
+	if( GetValue() >= pages.size() ) {
+		return -1;
+	}
+	return pages[ GetValue() ].index();
 }
 void TerminalGrpRadio::OnSelect(wxCommandEvent &event) {
 	TermView* parent = static_cast<TermView*>(GetParent());
-	auto p = selected();
-	if( p ) {
-		parent->pageBar->SetMax( p->size() - 1 );
+	int group = selected();
+	if( group != -1 ) {
+		parent->pageBar->SetMax( parent->ls->selected()->group( parent->itemSelector->selected(), group ).size() - 1 );
 	}
 	parent->tPanel->update();
 }
@@ -208,205 +169,48 @@ void TerminalPageSlider::onScroll(wxScrollEvent& event) {
 	parent->tPanel->update();
 }
 
-static const wxColour termColor[] = {
-	wxColour(0, 255, 0),
-	wxColour(255, 255, 255),
-	wxColour(255, 0, 0),
-	wxColour(0, 153, 0),
-	wxColour(0, 255, 255),
-	wxColour(255, 255, 0),
-	wxColour(153, 0, 0),
-	wxColour(0, 0, 255),
-};
-static wxColour rubiconTermColor[] = {
-	wxColour(0, 255, 0),
-	wxColour(255, 255, 255),
-	wxColour(255, 0, 0),
-	wxColour(0, 153, 0),
-	wxColour(204, 204, 255),
-	wxColour(204, 204, 204),
-	wxColour(153, 0, 0),
-	wxColour(153, 153, 204),
-};
-
-static wxRichTextCtrl* draw_strings(wxWindow* parent, int width, int x, int y,
-									const std::vector<atque::TermRichText>& line,
-									wxTextAttrAlignment alignment = wxTEXT_ALIGNMENT_LEFT
-	) {
-	wxRichTextCtrl* ctrl = new wxRichTextCtrl(parent, 5500, wxEmptyString,
-											  wxPoint(x, y),
-											  wxSize(width, 266),
-											  wxVSCROLL | wxRE_MULTILINE | wxBORDER_NONE | wxRE_READONLY );
-	TermView* root = static_cast<TermView*>(parent->GetParent());
-	ctrl->SetBackgroundColour( *wxBLACK );
-	ctrl->BeginAlignment( alignment );
-	ctrl->BeginSuppressUndo();
-	wxFont font(10, wxFONTFAMILY_MODERN , wxFONTSTYLE_NORMAL,
-				wxFONTWEIGHT_NORMAL, false,  wxEmptyString );
-	ctrl->SetFont( font);
-	for( const auto& text : line ) {
-		if( text.text.empty() ) {
-			continue;
-		}
-		if( text.b ) {
-			ctrl->BeginBold();
-		}
-		if( text.i ) {
-			ctrl->BeginItalic();
-		}
-		if( text.u ) {
-			ctrl->BeginUnderline();
-		}
-		if( root->rubiconCheckbox->GetValue() ) {
-			ctrl->BeginTextColour(  rubiconTermColor[text.color] );
-		} else {
-			ctrl->BeginTextColour(  termColor[text.color] );
-		}
-		ctrl->WriteText( wxString::FromUTF8( text.text.c_str() ) );
-		ctrl->EndTextColour();
-		if( text.u ) {
-			ctrl->EndUnderline();
-		}
-		if( text.i ) {
-			ctrl->EndItalic();
-		}
-		if( text.b ) {
-			ctrl->EndBold();
-		}
-	}
-	ctrl->EndAlignment();
-	ctrl->EndSuppressUndo();
-	return ctrl;
-}
-
 void TerminalViewPanel::update() { 
-	DestroyChildren();
 	TermView* parent = static_cast<TermView*>(GetParent());
-	auto toDraw = parent->pageBar->selected();
-	if( ! toDraw ) {
+	int toDraw = parent->pageBar->selected();
+	shown = nullptr;
+	if( toDraw == -1 ) {
+		SetVirtualSize( GetClientSize() );
+		Refresh();
 		return;
 	}
-	auto rsrc = parent->rsrc;	
-	switch( toDraw->type ) {
-	case marathon::TerminalGrouping::kLogon :
-	case marathon::TerminalGrouping::kLogoff :
-	{
-		auto pict = rsrc->picts[ toDraw->permutation ]->image.get();
-		int yp = 32;
-		if( pict ) {
-			int x = pict->GetWidth();
-			wxStaticBitmap* pimage = new wxStaticBitmap(this, 5000, *pict, wxPoint(320-x/2, 27));
-			yp = 27 + pict->GetHeight();
-		} else {
-			char buf[64];
-			snprintf(buf, 64, "#LOGON/LOGOFF %d", toDraw->permutation);
-			new wxStaticText(this, 5000, buf, wxPoint( 0, 60 ), wxDefaultSize, wxALIGN_CENTRE_HORIZONTAL);			
-		}
-		auto textMap = draw_strings( this, 640, 0, yp, toDraw->line, wxTEXT_ALIGNMENT_CENTER );
-	}
-	break;
-	case marathon::TerminalGrouping::kPict : {
-		char buf[64];
-		snprintf(buf, 64, "#PICT %d", toDraw->permutation);
-		auto pict = rsrc->picts[ toDraw->permutation ];
-		if( toDraw->flags & marathon::TerminalGrouping::kCenterObject ) {
-			if( pict ) {
-				auto img = pict->image->ConvertToImage();
-				new wxImagePanel(this, wxBitmap( img ), 5000,  wxPoint(52, 27));
-			} else {
-				new wxStaticText(this, 5000, buf, wxPoint(52, 27 ), wxDefaultSize, wxALIGN_CENTRE_HORIZONTAL);			
-			}
-		} else if( toDraw->flags & marathon::TerminalGrouping::kDrawObjectOnRight ) {
-			draw_strings(this, 307, 9, 27, toDraw->line );
-			if( pict ) {
-				auto img = pict->image->ConvertToImage();
-				if( img.GetWidth() > 306 || img.GetHeight() > 266 ) {
-					// rescale
-					double scale = std::max(img.GetWidth() / 306.0, img.GetHeight() / 266.0);
-					img.Rescale( img.GetWidth() / scale, img.GetHeight() / scale );
-				}
-				// centering
-				wxPoint pos = wxPoint(324, 27);
-				pos.x += (306-img.GetWidth())/2;
-				pos.y += (266-img.GetHeight())/2;
-				new wxImagePanel(this, wxBitmap( img ), 5000,  pos);
-			} else {
-				new wxStaticText(this, 5000, buf, wxPoint(324, 27 ), wxDefaultSize, wxALIGN_CENTRE_HORIZONTAL);			
-			}
-		} else {
-			if( pict ) {
-				auto img = pict->image->ConvertToImage();
-				if( img.GetWidth() > 306 || img.GetHeight() > 266 ) {
-					// rescale
-					double scale = std::max(img.GetWidth() / 306.0, img.GetHeight() / 266.0);
-					img.Rescale( img.GetWidth() / scale, img.GetHeight() / scale );
-				}
-				// centering
-				wxPoint pos = wxPoint(9, 27);
-				pos.x += (306-img.GetWidth())/2;
-				pos.y += (266-img.GetHeight())/2;
-				new wxImagePanel(this, wxBitmap( img ), 5000,  pos);
-			} else {
-				new wxStaticText(this, 5000, buf, wxPoint(9, 27 ), wxDefaultSize, wxALIGN_CENTRE_HORIZONTAL);			
-			}
-			draw_strings(this, 307, 324, 27, toDraw->line );
+
+	// pages are rendered once and kept, most recently shown first
+	const atque::LevelTerminals* terminals = parent->ls->selected();
+	PageKey key( terminals, toDraw, parent->rubiconCheckbox->GetValue() );
+	for( auto it = pages.begin(); it != pages.end(); ++it ) {
+		if( it->first == key ) {
+			pages.splice( pages.begin(), pages, it );
+			shown = &it->second;
+			break;
 		}
-		
 	}
-		break;
-	case marathon::TerminalGrouping::kCheckpoint : {
-		char buf[128];
-		snprintf(buf, 128, "CHECKPOINT #%d", toDraw->permutation );
-		if( toDraw->flags & marathon::TerminalGrouping::kCenterObject ) {			
-			new wxStaticText(this, 2500, buf, wxPoint( 27, 27 ), wxDefaultSize, wxALIGN_CENTRE_HORIZONTAL);
-		} else if( toDraw->flags & marathon::TerminalGrouping::kDrawObjectOnRight ) {
-			draw_strings(this, 307, 9, 27, toDraw->line );
-			new wxStaticText(this, 2500, buf, wxPoint( 324, 27 ), wxDefaultSize, wxALIGN_CENTRE_HORIZONTAL);
-		} else {
-			new wxStaticText(this, 2500, buf, wxPoint( 9, 27 ), wxDefaultSize, wxALIGN_CENTRE_HORIZONTAL);
-			draw_strings(this, 307, 324, 27, toDraw->line );
+
+	if( ! shown ) {
+		WxTermRenderer renderer( *parent->rsrc, std::get<2>(key) );
+		pages.push_front( std::make_pair(key, renderer.RenderBitmap( terminals->page( toDraw ) )) );
+		if( pages.size() > kMaxPages ) {
+			pages.pop_back();
 		}
-		
-	}
-		break;
-	case marathon::TerminalGrouping::kInformation : 
-		draw_strings(this, 614, 27, 27, toDraw->line );
-		break;
-	case marathon::TerminalGrouping::kSound : {
-		char buf[128];
-		snprintf(buf, 128, "SOUND #%d", toDraw->permutation );
-		draw_strings(this, 614, 27, 47, toDraw->line );
-		break;
-	}
-	case marathon::TerminalGrouping::kIntralevelTeleport : {
-		char buf[128];
-		snprintf(buf, 128, "TELEPORT TO polygon %d", toDraw->permutation );
-		new wxStaticText(this, 2500, buf, wxPoint( 27, 27 ), wxDefaultSize, wxALIGN_CENTRE_HORIZONTAL);
-		break;
-	}
-	case marathon::TerminalGrouping::kInterlevelTeleport : {
-		std::string name = parent->rsrc->levels[ toDraw->permutation ].name;
-		name = "TELEPORT TO " + name;
-		new wxStaticText(this, 2500, name, wxPoint( 27, 27 ), wxDefaultSize, wxALIGN_CENTRE_HORIZONTAL);
-		break;
-	}
-	case marathon::TerminalGrouping::kStatic : {
-		char buf[128];
-		snprintf(buf, 128, "STATIC EFFECT in %d", toDraw->permutation );
-		new wxStaticText(this, 2500, buf, wxPoint( 27, 27 ), wxDefaultSize, wxALIGN_CENTRE_HORIZONTAL);
-		break;
-	}
-	case marathon::TerminalGrouping::kTag: {
-		char buf[64];
-		snprintf(buf, 64, "TAG %d", toDraw->permutation );
-		new wxStaticText(this, 2500, buf, wxPoint( 27, 27 ), wxDefaultSize, wxALIGN_CENTRE_HORIZONTAL);
-		break;
+		shown = &pages.front().second;
 	}
 
-	}
-	parent->Refresh();
+	// pages with more text than fits scroll
+	SetVirtualSize( shown->GetWidth(), shown->GetHeight() );
+	Scroll( 0, 0 );
+	Refresh();
 }
+
 void TerminalViewPanel::onPaint(wxPaintEvent& event) { 
+	wxPaintDC dc(this);
+	DoPrepareDC(dc);
+	if( shown ) {
+		dc.DrawBitmap( *shown, 0, 0, false );
+	}
 }
 
 BEGIN_EVENT_TABLE(LevelSelector, wxChoice)
@@ -425,7 +229,8 @@ BEGIN_EVENT_TABLE( TerminalPageSlider, wxSlider)
 EVT_SCROLL(TerminalPageSlider::onScroll)
 END_EVENT_TABLE();
 
-BEGIN_EVENT_TABLE( TerminalViewPanel, wxPanel)
+BEGIN_EVENT_TABLE( TerminalViewPanel, wxScrolledWindow)
+EVT_PAINT(TerminalViewPanel::onPaint)
 END_EVENT_TABLE();
 
 BEGIN_EVENT_TABLE( TerminalRubiconChkbox, wxCheckBox)
@@ -1,6 +1,8 @@
 /* -*- c++ -*- */
 #include <wx/wx.h>
 #include <wx/spinctrl.h>
+#include <list>
+#include <tuple>
 #include <vector>
 #include <memory>
 #include "split.h"
@@ -11,7 +13,7 @@ public:
 	DECLARE_EVENT_TABLE();
 public:
 	void OnSelect(wxCommandEvent &event);
-	const atque::Levels* selected();
+	const atque::LevelTerminals* selected();
 };
 
 class TerminalGroupSelector : public wxSpinCtrl {
@@ -19,15 +21,17 @@ public:
 	TerminalGroupSelector(wxWindow* parent);
 	void update(int max);
 	void OnSelect(wxSpinEvent &event);
-	const std::array<std::vector<atque::TermPage>, 3>* selected();
+	// the terminal, or -1
+	int selected();
 	DECLARE_EVENT_TABLE();
 };
 class TerminalGrpRadio : public wxRadioBox {
 public:
 	TerminalGrpRadio(wxWindow* parent);
-	void update(const std::array<std::vector<atque::TermPage>, 3>& data);
+	void update(const atque::LevelTerminals& terminals, int terminal);
 	void OnSelect(wxCommandEvent &event);
-	const std::vector<atque::TermPage>* selected();
+	// the group, or -1
+	int selected();
 
 	DECLARE_EVENT_TABLE();
 };
@@ -43,12 +47,18 @@ class TerminalPageSlider : public wxSlider {
 public:
 	 TerminalPageSlider (wxWindow* parent)
 		 :wxSlider(parent, 2500, 0, 0, 1, wxDefaultPosition, wxSize(640, 20)) {}
-	const atque::TermPage* selected();
+	// the page's index in its level, or -1
+	int selected();
 	void onScroll(wxScrollEvent& event);
 	DECLARE_EVENT_TABLE();
 };
 
-class TerminalViewPanel : public wxPanel {
+class TerminalViewPanel : public wxScrolledWindow {
+	// a level, a page in it, and whether it's in Rubicon colors
+	typedef std::tuple<const atque::LevelTerminals*, int, bool> PageKey;
+	enum { kMaxPages = 32 };
+	std::list<std::pair<PageKey, wxBitmap>> pages;
+	const wxBitmap* shown;
 public:
 	TerminalViewPanel(wxWindow* parent);
 	void update();
@@ -58,13 +68,14 @@ public:
 class TermView: public wxFrame {
 public:
 	// read data
-	atque::Resources* rsrc;
+	std::shared_ptr<atque::Resources> rsrc;
 	LevelSelector* ls;
 	TerminalGroupSelector* itemSelector;
 	TerminalGrpRadio* termGrpRadio;
 	TerminalRubiconChkbox* rubiconCheckbox;
 	TerminalPageSlider* pageBar;
 	TerminalViewPanel* tPanel;
-	TermView(atque::Resources* rsrc, const std::vector<wxString>& levels);
-	~TermView();
+	TermView(std::shared_ptr<atque::Resources> rsrc, const std::vector<wxString>& levels);
+	// rsrc->level_terminals[index] has been filled in
+	void levelDecoded(int index);
 };
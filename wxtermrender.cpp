@@ -0,0 +1,121 @@
+/* wxtermrender.cpp
+
+   Copyright (C) 2008 by Gregory Smith
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   This license is contained in the file "COPYING", which is included
+   with this source code; it is available online at
+   http://www.gnu.org/licenses/gpl.html
+
+*/
+
+#include "wxtermrender.h"
+#include <algorithm>
+#include <cstring>
+#include <wx/mstream.h>
+
+namespace {
+	// the font the viewer has always used
+	wxFont TermFont( uint8 style ) {
+		return wxFont( 10, wxFONTFAMILY_MODERN,
+					   ( style & atque::TermString::kItalic ) ? wxFONTSTYLE_ITALIC : wxFONTSTYLE_NORMAL,
+					   ( style & atque::TermString::kBold ) ? wxFONTWEIGHT_BOLD : wxFONTWEIGHT_NORMAL,
+					   ( style & atque::TermString::kUnderline ) != 0, wxEmptyString );
+	}
+}
+
+atque::TermImage WxTermRenderer::Picture(const atque::PICTResource& pict) const
+{
+	if( ! pict.IsJPEG() ) {
+		return TermRenderer::Picture(pict);
+	}
+	atque::TermImage picture(pict.Width(), pict.Height());
+	wxImage img;
+	wxMemoryInputStream mis(pict.JPEGData().data(), pict.JPEGData().size());
+	if( img.LoadFile(mis, wxBITMAP_TYPE_JPEG) ) {
+		// cropped to the size the PICT says
+		int w = std::min(img.GetWidth(), picture.width);
+		for( int y = 0; y < std::min(img.GetHeight(), picture.height); ++y ) {
+			memcpy(picture.row(y), img.GetData() + y * img.GetWidth() * 3, w * 3);
+		}
+	}
+	return picture;
+}
+
+int WxTermRenderer::Advance(uint32 code, uint8 style) const
+{
+	auto key = std::make_pair( code, style );
+	auto it = advances.find( key );
+	if( it != advances.end() ) {
+		return it->second;
+	}
+
+	// a font with no glyph for the code point measures nothing, and
+	// TermRenderer draws it instead
+	wxBitmap scratch( 1, 1 );
+	wxMemoryDC dc( scratch );
+	dc.SetFont( TermFont( style ) );
+	wxCoord width = 0;
+	wxCoord height = 0;
+	dc.GetTextExtent( wxString( wxUniChar( code ) ), &width, &height );
+	advances[ key ] = std::max( 0, static_cast<int>( width ) );
+	return advances[ key ];
+}
+
+int WxTermRenderer::LineHeight() const
+{
+	if( ! lineHeight ) {
+		wxBitmap scratch( 1, 1 );
+		wxMemoryDC dc( scratch );
+		dc.SetFont( TermFont( 0 ) );
+		lineHeight = std::max<int>( kLineHeight, dc.GetCharHeight() );
+	}
+	return lineHeight;
+}
+
+wxBitmap WxTermRenderer::DrawBitmap(atque::TermImage& image, const std::vector<atque::TermString>& strings) const
+{
+	for( const auto& string : strings ) {
+		if( string.builtin ) {
+			DrawBuiltin( image, string );
+		}
+	}
+
+	wxImage img( image.width, image.height, false );
+	memcpy( img.GetData(), image.pixels.data(), image.pixels.size() );
+	wxBitmap bitmap( img );
+	wxMemoryDC dc( bitmap );
+	for( const auto& string : strings ) {
+		if( string.builtin ) {
+			continue;
+		}
+		const uint8* color = Color( string.color );
+		dc.SetFont( TermFont( string.style ) );
+		dc.SetTextForeground( wxColour( color[0], color[1], color[2] ) );
+		dc.DrawText( wxString::FromUTF8( string.text.data(), string.text.size() ), string.x, string.y );
+	}
+	dc.SelectObject( wxNullBitmap );
+	return bitmap;
+}
+
+void WxTermRenderer::DrawStrings(atque::TermImage& image, const std::vector<atque::TermString>& strings) const
+{
+	wxImage img = DrawBitmap( image, strings ).ConvertToImage();
+	memcpy( image.pixels.data(), img.GetData(), image.pixels.size() );
+}
+
+wxBitmap WxTermRenderer::RenderBitmap(const atque::TermPage& page) const
+{
+	std::vector<atque::TermString> strings;
+	atque::TermImage image = Layout( page, strings );
+	return DrawBitmap( image, strings );
+}
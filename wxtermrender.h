@@ -0,0 +1,62 @@
+/* wxtermrender.h
+
+   Copyright (C) 2008 by Gregory Smith
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   This license is contained in the file "COPYING", which is included
+   with this source code; it is available online at
+   http://www.gnu.org/licenses/gpl.html
+
+*/
+
+/*
+  TermRenderer with the viewer's wx font, so terminal text in any
+  script shows up
+*/
+
+#ifndef WXTERMRENDER_H
+#define WXTERMRENDER_H
+
+#include <map>
+#include <utility>
+#include <vector>
+#include <wx/wx.h>
+#include "termrender.h"
+
+// JPEG pictures are decoded by wx and text is drawn in a wx font;
+// glyphs the font has none for, and everything else, are left to
+// TermRenderer. wx only works on the main thread, so this is for the
+// viewer, not render_terminals
+class WxTermRenderer : public atque::TermRenderer {
+public:
+	WxTermRenderer(const atque::Resources& rsrc, bool rubicon)
+		:TermRenderer(rsrc, rubicon), lineHeight(0) {}
+
+	// the page drawn straight into a bitmap, for showing
+	wxBitmap RenderBitmap(const atque::TermPage& page) const;
+
+protected:
+	atque::TermImage Picture(const atque::PICTResource& pict) const override;
+	int Advance(uint32 code, uint8 style) const override;
+	int LineHeight() const override;
+	void DrawStrings(atque::TermImage& image, const std::vector<atque::TermString>& strings) const override;
+
+private:
+	// draws the strings onto image and returns the result as a
+	// bitmap
+	wxBitmap DrawBitmap(atque::TermImage& image, const std::vector<atque::TermString>& strings) const;
+
+	mutable std::map<std::pair<uint32, uint8>, int> advances;
+	mutable int lineHeight;
+};
+
+#endif